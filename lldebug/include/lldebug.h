@@ -35,6 +35,7 @@ extern "C" {
 #include "lualib.h"
 #include "lauxlib.h"
 #include "llencoding.h"
+#include "llprofile.h"
 
 #ifdef LLDEBUG_BUILD_DLL
 	#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
@@ -75,6 +76,82 @@ LLDEBUG_API int lldebug_setencoding(lua_State *L, lldebug_Encoding encoding);
 /// Get the encoding type for displaying on debugger.
 LLDEBUG_API lldebug_Encoding lldebug_getencoding(lua_State *L);
 
+/// Set the max length of the value string that is shown before it's opened.
+/** The minus value means no limit.
+ */
+LLDEBUG_API int lldebug_setpreviewlength(lua_State *L, int length);
+/// Get the max length of the value string that is shown before it's opened.
+LLDEBUG_API int lldebug_getpreviewlength(lua_State *L);
+
+/// Native formatter type of the value shown on debugger.
+/** It pushes the string of the value(idx) and returns 1,
+ * or returns 0 to use the default formatter.
+ * It's called without the protection, so it mustn't raise any errors.
+ */
+typedef int (*lldebug_Formatter)(lua_State *L, int idx);
+/// Register the formatter for the values that have the metatable(idx).
+/** It's used before 'lldebug.tostring_for_varvalue'.
+ * If 'formatter' is NULL, the formatter is removed.
+ */
+LLDEBUG_API int lldebug_registerformatter(lua_State *L, int idx,
+										  lldebug_Formatter formatter);
+/// Register the formatter for the values that have the metatable
+/// made by 'luaL_newmetatable(L, tname)'.
+LLDEBUG_API int lldebug_registertypeformatter(lua_State *L, const char *tname,
+											  lldebug_Formatter formatter);
+
+/// Start the profiler, the old profile is cleared.
+/** 'interval' is the count of the instructions between the samples
+ * of LLDEBUG_PROFILEMODE_SAMPLING and LLDEBUG_PROFILEMODE_INSTRUCTIONS,
+ * LLDEBUG_DEFAULT_SAMPLEINTERVAL or LLDEBUG_DEFAULT_COUNTINTERVAL
+ * is used if it's zero or minus.
+ * The breakpoints don't work while profiling.
+ */
+LLDEBUG_API int lldebug_startprofiler(lua_State *L, lldebug_ProfileMode mode,
+									  int interval);
+/// Stop the profiler.
+LLDEBUG_API int lldebug_stopprofiler(lua_State *L);
+/// Write the profile to the file.
+LLDEBUG_API int lldebug_dumpprofile(lua_State *L, const char *filename,
+									lldebug_ProfileFormat format);
+
+/// Start recording the line coverage, the old coverage is cleared.
+/** The coverage is written to 'filename' with the lcov format
+ * by 'lldebug_close', if 'filename' isn't NULL.
+ * The breakpoints don't work in the functions whose lines were all executed.
+ */
+LLDEBUG_API int lldebug_startcoverage(lua_State *L, const char *filename);
+/// Stop recording the line coverage.
+LLDEBUG_API int lldebug_stopcoverage(lua_State *L);
+/// Write the coverage to the file with the lcov format.
+LLDEBUG_API int lldebug_dumpcoverage(lua_State *L, const char *filename);
+
+/// Start recording the trace spans, the old spans are cleared.
+/** The calls of the functions are recorded as the spans too
+ * if 'autoSpans' isn't zero. 'capacity' is the count of the spans kept
+ * for each lua_State, LLDEBUG_DEFAULT_SPANCAPACITY is used
+ * if it's zero or minus.
+ */
+LLDEBUG_API int lldebug_startspans(lua_State *L, int autoSpans, int capacity);
+/// Stop recording the trace spans.
+LLDEBUG_API int lldebug_stopspans(lua_State *L);
+/// Begin the trace span of 'L'.
+LLDEBUG_API int lldebug_spanbegin(lua_State *L, const char *name);
+/// End the last trace span of 'L' begun by 'lldebug_spanbegin'.
+LLDEBUG_API int lldebug_spanend(lua_State *L);
+/// Write the trace spans to the file with the chrome trace event format.
+LLDEBUG_API int lldebug_dumpspans(lua_State *L, const char *filename);
+
+/// Start the governor that keeps the overhead of the hooks under
+/// 'maxOverhead' percent.
+/** The interval of the sampling is widened and the samples are weighted
+ * by it, and the line hook of the coverage is dropped without the frame.
+ * LLDEBUG_DEFAULT_MAXOVERHEAD is used if it's zero or minus.
+ */
+LLDEBUG_API int lldebug_startgovernor(lua_State *L, double maxOverhead);
+/// Stop the governor.
+LLDEBUG_API int lldebug_stopgovernor(lua_State *L);
+
 
 /// Set the host address and service name if you want to debug remotely.
 /**
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __LLDEBUG_PROFILE_H__
+#define __LLDEBUG_PROFILE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The way of the profiling.
+ */
+typedef enum lldebug_ProfileMode {
+	LLDEBUG_PROFILEMODE_SAMPLING, /**< samples by the count hook */
+	LLDEBUG_PROFILEMODE_TRACING, /**< times each call by the call hooks */
+	LLDEBUG_PROFILEMODE_INSTRUCTIONS, /**< counts the instructions by the count hook */
+} lldebug_ProfileMode;
+
+/**
+ * @brief The output format of the profile.
+ */
+typedef enum lldebug_ProfileFormat {
+	LLDEBUG_PROFILEFORMAT_CALLTREE, /**< indented call tree (text) */
+	LLDEBUG_PROFILEFORMAT_FUNCTIONS, /**< functions sorted by the self cost and the coroutines (text) */
+	LLDEBUG_PROFILEFORMAT_CALLGRIND, /**< callgrind format for kcachegrind */
+	LLDEBUG_PROFILEFORMAT_FOLDED, /**< collapsed stacks for flamegraph.pl */
+} lldebug_ProfileFormat;
+
+/// The default instructions between the samples.
+#define LLDEBUG_DEFAULT_SAMPLEINTERVAL 10000
+
+/// The default instructions between the counts,
+/// each count is weighted by the interval.
+#define LLDEBUG_DEFAULT_COUNTINTERVAL 1
+
+/// The default count of the spans kept for each lua_State.
+#define LLDEBUG_DEFAULT_SPANCAPACITY 65536
+
+/// The default limit of the overhead of the hooks (%).
+#define LLDEBUG_DEFAULT_MAXOVERHEAD 2.0
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
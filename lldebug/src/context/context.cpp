@@ -54,6 +54,21 @@
 /// Dummy function name for eval.
 #define DUMMY_FUNCNAME "__LLDEBUG_DUMMY_FUNCTION__"
 
+/// The default max length of the value string sent with LuaVar.
+#ifndef LLDEBUG_DEFAULT_PREVIEWLENGTH
+#define LLDEBUG_DEFAULT_PREVIEWLENGTH 1024
+#endif
+
+/// The max count of the compiled eval functions that are cached.
+#ifndef LLDEBUG_EVALCACHE_SIZE
+#define LLDEBUG_EVALCACHE_SIZE 256
+#endif
+
+/// The instructions between the checks of the eval budget.
+#ifndef LLDEBUG_EVALBUDGET_STEP
+#define LLDEBUG_EVALBUDGET_STEP 1000
+#endif
+
 namespace lldebug {
 namespace context {
 
@@ -106,6 +121,13 @@ public:
 		}
 	}
 
+	/// Erase the lua_State object only.
+	void Erase(lua_State *L) {
+		scoped_lock lock(m_mutex);
+
+		m_map.erase(L);
+	}
+
 	/// Find the Context object from a lua_State object.
 	shared_ptr<Context> Find(lua_State *L) {
 		scoped_lock lock(m_mutex);
@@ -134,7 +156,7 @@ shared_ptr<Context::ContextManager> Context::ms_manager;
 
 struct StdOutLogger {
 	void operator()(shared_ptr<Context> ctx, const LogData &data) {
-		const Source *source = ctx->GetSource(data.GetKey());
+		const Source *source = ctx->GetSource(data.GetSourceId());
 
 		if (data.GetType() == LOGTYPE_TRACE) {
 			std::cout << (data.IsRemote() ? "Frame: ": "Context: ");
@@ -154,8 +176,13 @@ struct StdOutLogger {
 
 Context::Context()
 	: m_lua(NULL)/*, m_state(STATE_INITIAL)*/
-	, m_debugState(DEBUGSTATE_INITIAL), m_isEnabled(true)
+	, m_debugState(DEBUGSTATE_INITIAL), m_isEnabled(true), m_isDetached(false)
 	, m_updateCount(0), m_waitUpdateCount(0), m_isMustUpdate(false)
+	, m_isWatchesNeeded(false)
+	, m_formatterUpdateCount(-1), m_isNativeFormatter(false)
+	, m_previewLength(LLDEBUG_DEFAULT_PREVIEWLENGTH)
+	, m_hasEvalBudget(false), m_evalDepth(0), m_evalInstructions(0)
+	, m_heatGeneration(0)
 	, m_engine(new RemoteEngine)
 	, m_sourceManager(m_engine), m_breakpoints(m_engine) {
 
@@ -230,7 +257,7 @@ int Context::CreateDebuggerFrame() {
 		"lldebug doesn't work correctly, because the frame was not found.\n"
 		"Now this program starts without debugging.\n"
 		"(If you want to debug visually, please excute 'lldebug_frame(.exe)' first.)");
-	SetDebugEnable(false);
+	m_isDetached = true;
 	return -1;
 }
 
@@ -287,6 +314,15 @@ void Context::Delete() {
 		return;
 	}
 
+	// The coverage is written at the end of the program.
+	if (!m_coverage.GetOutputFile().empty()) {
+		if (SaveCoverage(m_coverage.GetOutputFile()) != 0) {
+			OutputLog(LOGTYPE_ERROR,
+				"Couldn't write the coverage to '" +
+				m_coverage.GetOutputFile() + "'.");
+		}
+	}
+
 	// Erase this from the context manager.
 	ms_manager->Erase(shared_from_this());
 
@@ -382,6 +418,27 @@ void Context::SetEncoding(lldebug_Encoding encoding) {
 	m_engine->SendSetEncoding(encoding);
 }
 
+void Context::SetPreviewLength(int length) {
+	scoped_lock lock(m_mutex);
+
+	m_previewLength = length;
+}
+
+/// Set the new update count.
+/** The values kept for the full value fetch are released,
+ * because the frame never requests them after this.
+ */
+void Context::SetUpdateCount(int updateCount) {
+	scoped_lock lock(m_mutex);
+
+	if (updateCount <= m_updateCount) {
+		return;
+	}
+
+	m_updateCount = updateCount;
+	llutil_clearkeptvalues(GetMainLua());
+}
+
 /// Parse the lua error that forat is like 'FILENAME:LINE:str...'.
 Context::LuaErrorData Context::ParseLuaError(const std::string &str) {
 	scoped_lock lock(m_mutex);
@@ -475,7 +532,10 @@ void Context::OutputLogInternal(const LogData &logData, bool sendRemote) {
 
 void Context::OutputLog(LogType type, const std::string &str,
 						const std::string &key, int line) {
-	OutputLogInternal(LogData(type, str, key, line), true);
+	const Source *source = GetSource(key);
+	int sourceId = (source != NULL ? source->GetId() : -1);
+
+	OutputLogInternal(LogData(type, str, key, line, sourceId), true);
 }
 
 void Context::OutputLuaError(const char *str) {
@@ -532,23 +592,22 @@ int Context::HandleCommand() {
 			break;
 
 		case REMOTECOMMANDTYPE_FORCE_UPDATESOURCE:
+			command.GetData().Get_ForceUpdateSource(m_isWatchesNeeded);
 			m_isMustUpdate = true;
 			break;
 		case REMOTECOMMANDTYPE_SAVE_SOURCE:
 			{
-				std::string key;
+				int sourceId;
 				string_array sources;
-				command.GetData().Get_SaveSource(key, sources);
-				m_sourceManager.Save(key, sources);
+				command.GetData().Get_SaveSource(sourceId, sources);
+				m_sourceManager.Save(sourceId, sources);
 			}
 			break;
 		case REMOTECOMMANDTYPE_SET_UPDATECOUNT:
 			{
 				int count;
 				command.GetData().Get_SetUpdateCount(count);
-				if (count > m_updateCount) {
-					m_updateCount = count;
-				}
+				SetUpdateCount(count);
 			}
 			break;
 
@@ -564,24 +623,72 @@ int Context::HandleCommand() {
 			{
 				string_array evals;
 				LuaStackFrame stackFrame;
-				command.GetData().Get_EvalsToVarList(evals, stackFrame);
-				m_engine->ResponseVarList(command, LuaEvalsToVarList(evals, stackFrame, true));
+				LuaEvalBudget budget;
+				command.GetData().Get_EvalsToVarList(evals, stackFrame, budget);
+				m_engine->ResponseVarList(command,
+					LuaEvalsToVarList(evals, stackFrame, true, budget));
 			}
 			break;
 		case REMOTECOMMANDTYPE_EVAL_TO_MULTIVAR:
 			{
 				std::string eval;
 				LuaStackFrame stackFrame;
-				command.GetData().Get_EvalToMultiVar(eval, stackFrame);
-				m_engine->ResponseVarList(command, LuaEvalToMultiVar(eval, stackFrame, true));
+				LuaEvalBudget budget;
+				command.GetData().Get_EvalToMultiVar(eval, stackFrame, budget);
+				m_engine->ResponseVarList(command,
+					LuaEvalToMultiVar(eval, stackFrame, true, budget));
 			}
 			break;
 		case REMOTECOMMANDTYPE_EVAL_TO_VAR:
 			{
 				std::string eval;
 				LuaStackFrame stackFrame;
-				command.GetData().Get_EvalToVar(eval, stackFrame);
-				m_engine->ResponseVar(command, LuaEvalToVar(eval, stackFrame, true));
+				LuaEvalBudget budget;
+				command.GetData().Get_EvalToVar(eval, stackFrame, budget);
+				m_engine->ResponseVar(command,
+					LuaEvalToVar(eval, stackFrame, true, budget));
+			}
+			break;
+		case REMOTECOMMANDTYPE_ADD_WATCH:
+			{
+				int watchId;
+				std::string eval;
+				command.GetData().Get_AddWatch(watchId, eval);
+				m_watches[watchId] = eval;
+			}
+			break;
+		case REMOTECOMMANDTYPE_REMOVE_WATCH:
+			{
+				int watchId;
+				command.GetData().Get_RemoveWatch(watchId);
+				m_watches.erase(watchId);
+			}
+			break;
+
+		case REMOTECOMMANDTYPE_START_PROFILER:
+			{
+				lldebug_ProfileMode mode;
+				int interval;
+				command.GetData().Get_StartProfiler(mode, interval);
+				StartProfiler(mode, interval);
+			}
+			break;
+		case REMOTECOMMANDTYPE_STOP_PROFILER:
+			m_profiler.Stop();
+			break;
+		case REMOTECOMMANDTYPE_REQUEST_PROFILE:
+			{
+				lldebug_ProfileFormat format;
+				command.GetData().Get_RequestProfile(format);
+				m_engine->ResponseString(command, m_profiler.Dump(format));
+			}
+			break;
+		case REMOTECOMMANDTYPE_REQUEST_LINEHEATS:
+			{
+				std::vector<int> sourceIds;
+				command.GetData().Get_RequestLineHeats(sourceIds);
+				m_engine->ResponseLineHeats(command, m_heatGeneration,
+					GetLineHeats(sourceIds));
 			}
 			break;
 		
@@ -602,41 +709,66 @@ int Context::HandleCommand() {
 
 		case REMOTECOMMANDTYPE_REQUEST_FIELDSVARLIST:
 			{
-				LuaVar var;
-				command.GetData().Get_RequestFieldVarList(var);
-				m_engine->ResponseVarList(command, LuaGetFields(var));
+				LuaVarRef ref;
+				int updateCount;
+				LuaVarFilter filter;
+				int prefetchBytes, prefetchDepth;
+				command.GetData().Get_RequestFieldVarList(
+					ref, updateCount, filter, prefetchBytes, prefetchDepth);
+				LuaVarList vars = LuaGetFields(ref, updateCount, filter);
+				m_engine->ResponseVarList(command, vars,
+					LuaPrefetchFields(vars, filter, prefetchBytes, prefetchDepth));
 			}
 			break;
 		case REMOTECOMMANDTYPE_REQUEST_LOCALVARLIST:
 			{
 				LuaStackFrame stackFrame;
 				bool checkLocal, checkUpvalue, checkEnviron;
+				LuaVarFilter filter;
 				command.GetData().Get_RequestLocalVarList(
-					stackFrame, checkLocal, checkUpvalue, checkEnviron);
+					stackFrame, checkLocal, checkUpvalue, checkEnviron, filter);
 				m_engine->ResponseVarList(command, LuaGetLocals(stackFrame,
-					checkLocal, checkUpvalue, checkEnviron));
+					checkLocal, checkUpvalue, checkEnviron, filter));
 			}
 			break;
 		case REMOTECOMMANDTYPE_REQUEST_GLOBALVARLIST:
-			m_engine->ResponseVarList(command, LuaGetGlobals());
+			{
+				LuaVarFilter filter;
+				command.GetData().Get_RequestGlobalVarList(filter);
+				m_engine->ResponseVarList(command, LuaGetGlobals(filter));
+			}
 			break;
 		case REMOTECOMMANDTYPE_REQUEST_REGISTRYVARLIST:
-			m_engine->ResponseVarList(command, LuaGetRegistories());
+			{
+				LuaVarFilter filter;
+				command.GetData().Get_RequestRegistryVarList(filter);
+				m_engine->ResponseVarList(command, LuaGetRegistories(filter));
+			}
 			break;
 		case REMOTECOMMANDTYPE_REQUEST_STACKLIST:
 			m_engine->ResponseVarList(command, LuaGetStack());
 			break;
 		case REMOTECOMMANDTYPE_REQUEST_SOURCE:
 			{
-				std::string key;
-				command.GetData().Get_RequestSource(key);
-				const Source *source = m_sourceManager.Get(key);
+				int sourceId;
+				command.GetData().Get_RequestSource(sourceId);
+				const Source *source = m_sourceManager.Get(sourceId);
 				m_engine->ResponseSource(command, (source != NULL ? *source : Source()));
 			}
 			break;
 		case REMOTECOMMANDTYPE_REQUEST_BACKTRACELIST:
 			m_engine->ResponseBacktraceList(command, LuaGetBacktrace());
 			break;
+		case REMOTECOMMANDTYPE_REQUEST_VARVALUE:
+			{
+				LuaVarRef ref;
+				int updateCount, offset, length;
+				command.GetData().Get_RequestVarValue(
+					ref, updateCount, offset, length);
+				m_engine->ResponseString(command,
+					LuaGetVarValue(ref, updateCount, offset, length));
+			}
+			break;
 
 		case REMOTECOMMANDTYPE_SUCCESSED:
 		case REMOTECOMMANDTYPE_FAILED:
@@ -651,6 +783,7 @@ int Context::HandleCommand() {
 		case REMOTECOMMANDTYPE_VALUE_VAR:
 		case REMOTECOMMANDTYPE_VALUE_VARLIST:
 		case REMOTECOMMANDTYPE_VALUE_BACKTRACELIST:
+		case REMOTECOMMANDTYPE_VALUE_LINEHEATS:
 			assert(false && "Command type is invalid.");
 			break;
 		}
@@ -659,12 +792,103 @@ int Context::HandleCommand() {
 	return 0;
 }
 
+/**
+ * @brief Measures the time in the hook for the governor.
+ *
+ * The hook is changed when this object is destroyed,
+ * if the level of the governor was changed.
+ */
+class Context::GovernorScope {
+public:
+	explicit GovernorScope(Context *ctx, lua_State *L)
+		: m_ctx(ctx), m_L(L), m_enterTime(0) {
+		if (ctx->m_governor.IsRunning()) {
+			m_enterTime = ctx->m_governor.Enter();
+		}
+	}
+
+	~GovernorScope() {
+		if (m_enterTime != 0 && m_ctx->m_governor.IsRunning()
+			&& m_ctx->m_governor.Leave(m_enterTime)) {
+			m_ctx->ApplyGovernor(m_L);
+		}
+	}
+
+private:
+	Context *m_ctx;
+	lua_State *m_L;
+	Governor::Cost m_enterTime;
+};
+
+/// Get the hook mask for the current mode.
+int Context::GetHookMask() {
+	scoped_lock lock(m_mutex);
+
+	if (m_profiler.IsSampling()) {
+		// The calls are needed by the automatic spans.
+		return (m_spans.IsAutoSpans()
+			? (LUA_MASKCOUNT | LUA_MASKCALL | LUA_MASKRET)
+			: LUA_MASKCOUNT);
+	}
+	else if (m_coverage.IsRunning()
+		&& !(m_isDetached && m_governor.GetLevel() > 0)) {
+		return (LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET);
+	}
+	else if (m_profiler.IsTracing() || m_isDetached) {
+		// The call hooks are kept without the frame,
+		// so the profiler can be started later.
+		return (LUA_MASKCALL | LUA_MASKRET);
+	}
+	else {
+		return (LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET);
+	}
+}
+
+/// Set the hook for the current mode.
+/** The hooks of the other lua_State objects are changed
+ * at their first events after the mode was changed.
+ */
 void Context::SetHook(lua_State *L) {
-	int mask = LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET;
-	lua_sethook(L, Context::s_HookCallback, mask, 0);
+	scoped_lock lock(m_mutex);
+
+	int mask = GetHookMask();
+	int count = (mask & LUA_MASKCOUNT ? m_profiler.GetSampleInterval() : 0);
+	lua_sethook(L, Context::s_HookCallback, mask, count);
+}
+
+/// Set or unset the line hook for the coverage of the current function.
+/** The line hook is kept while the frame is attached,
+ * because the breakpoints may be hit even while running.
+ */
+void Context::SetCoverageHook(lua_State *L, bool needsLine) {
+	scoped_lock lock(m_mutex);
+
+	if (!needsLine && !m_isDetached) {
+		needsLine = true;
+	}
+	else if (needsLine && m_isDetached && m_governor.GetLevel() > 0) {
+		needsLine = false; // dropped by the governor
+	}
+
+	int mask = lua_gethookmask(L);
+	int newMask = (needsLine ? mask | LUA_MASKLINE : mask & ~LUA_MASKLINE);
+	if (newMask != mask) {
+		lua_sethook(L, Context::s_HookCallback, newMask, lua_gethookcount(L));
+	}
 }
 
 void Context::s_HookCallback(lua_State *L, lua_Debug *ar) {
+	// The count hook is used for the eval budget and the profiler.
+	if (ar->event == LUA_HOOKCOUNT) {
+		char message[128];
+		if (s_CountHookCallback(L, message, sizeof(message)) != 0) {
+			// 'luaL_error' doesn't return (longjmp),
+			// so any C++ objects mustn't be alive here.
+			luaL_error(L, "%s", message);
+		}
+		return;
+	}
+
 	shared_ptr<Context> ctx = Context::Find(L);
 
 	if (ctx != NULL) {
@@ -772,6 +996,55 @@ void Context::HookCallback(lua_State *L, lua_Debug *ar) {
 
 	scoped_lock lock(m_mutex);
 	assert(m_debugState != DEBUGSTATE_INITIAL && "Not initialized !!!");
+	GovernorScope governorScope(this, L);
+
+	// The hook of the old mode is changed at the first event.
+	// The hook of the eval thread is set by LuaEval,
+	// and the line hook is changed for each function while covering.
+	int mask = lua_gethookmask(L);
+	int hookMask = GetHookMask();
+	if (m_coverage.IsRunning()) {
+		mask = (mask & ~LUA_MASKLINE) | (hookMask & LUA_MASKLINE);
+	}
+	if (m_evalDepth == 0 && mask != hookMask) {
+		SetHook(L);
+	}
+
+	// The calls are the spans while recording them automatically.
+	if (m_spans.IsAutoSpans() && m_evalDepth == 0) {
+		switch (ar->event) {
+		case LUA_HOOKCALL:
+			m_spans.OnCall(L, ar);
+			break;
+		case LUA_HOOKRET:
+			m_spans.OnReturn(L, ar);
+			break;
+		case LUA_HOOKTAILRET:
+			m_spans.OnTailReturn(L);
+			break;
+		default:
+			break;
+		}
+	}
+
+	// The call count is kept even while sampling,
+	// the call and return hooks may be set by the spans.
+	switch (ar->event) {
+	case LUA_HOOKCALL:
+		++m_coroutines.back().call;
+		break;
+	case LUA_HOOKRET:
+	case LUA_HOOKTAILRET:
+		--m_coroutines.back().call;
+		break;
+	default:
+		break;
+	}
+
+	// The line hook isn't used while sampling.
+	if (m_profiler.IsSampling()) {
+		return;
+	}
 
 #if 0
 	{
@@ -795,22 +1068,55 @@ void Context::HookCallback(lua_State *L, lua_Debug *ar) {
 
 	switch (ar->event) {
 	case LUA_HOOKCALL:
-		++m_coroutines.back().call;
+		if (m_profiler.IsTracing()) {
+			m_profiler.OnCall(L, ar);
+		}
+		if (m_coverage.IsRunning() && m_evalDepth == 0) {
+			SetCoverageHook(L, m_coverage.OnCall(L, ar));
+		}
+
+		// The line hook may not be called,
+		// so the commands from the frame are handled here.
+		if ((m_profiler.IsTracing() || m_coverage.IsRunning())
+			&& !m_readCommands.empty()) {
+			HandleCommand();
+		}
 		return;
 	case LUA_HOOKRET:
 	case LUA_HOOKTAILRET:
+		// The count has been decremented already.
 		if (m_debugState == DEBUGSTATE_STEPRETURN) {
 			const CoroutineInfo &info = m_coroutines.back();
-			if (m_stepinfo.L == info.L  && info.call <= m_stepinfo.call) {
+			if (m_stepinfo.L == info.L  && info.call < m_stepinfo.call) {
 				SetDebugState(DEBUGSTATE_BREAK);
 			}
 		}
-		--m_coroutines.back().call;
+		if (m_profiler.IsTracing()) {
+			if (ar->event == LUA_HOOKTAILRET) {
+				m_profiler.OnTailReturn(L);
+			}
+			else {
+				m_profiler.OnReturn(L, ar);
+			}
+		}
+		if (m_coverage.IsRunning() && m_evalDepth == 0
+			&& ar->event == LUA_HOOKRET) {
+			SetCoverageHook(L, m_coverage.OnReturn(L));
+		}
 		return;
 	default:
 		break;
 	}
 
+	if (m_coverage.IsRunning()) {
+		m_coverage.OnLine(L, ar);
+	}
+
+	// Only the profiler works without the frame.
+	if (m_isDetached) {
+		return;
+	}
+
 	// Stop running if need.
 	switch (m_debugState) {
 	case DEBUGSTATE_STEPOVER: {
@@ -854,22 +1160,37 @@ void Context::HookCallback(lua_State *L, lua_Debug *ar) {
 			break;
 		}
 		if (m_isMustUpdate || prevState != DEBUGSTATE_BREAK) {
-			if (m_sourceManager.Get(ar->source) == NULL) {
+			const Source *source = m_sourceManager.Get(ar->source);
+			if (source == NULL) {
 				if (m_sourceManager.Add(ar->source, ar->short_src) != 0) {
 					OutputLog(LOGTYPE_ERROR,
 						std::string("Couldn't open the '") + ar->short_src + "' file.");
 				}
+				source = m_sourceManager.Get(ar->source);
 			}
 			m_isMustUpdate = false;
 
 			// If the state has been 'break', this update is only for refresh.
+			// The registered watches are sent with it, but the frame
+			// throws them away if it shows the other stack frame.
+			bool isRefreshOnly = (prevState == DEBUGSTATE_BREAK);
+			LuaWatchResults watches;
+			if (!isRefreshOnly || m_isWatchesNeeded) {
+				watches = EvalWatches(L);
+			}
+			m_isWatchesNeeded = false;
+
+			SetUpdateCount(m_updateCount + 1);
 			m_engine->SendUpdateSource(
-				ar->source, ar->currentline,
-				++m_updateCount, (prevState == DEBUGSTATE_BREAK),
+				(source != NULL ? source->GetId() : -1), ar->currentline,
+				m_updateCount, isRefreshOnly, watches,
 				UpdateResponseWaiter(&m_waitUpdateCount));
 		}
 		prevState = m_debugState;
 
+		// The time waiting for the frame isn't the overhead.
+		m_governor.Interrupt();
+
 		// Wait...
 		if (m_readCommands.empty()) {
 			boost::xtime xt;
@@ -880,108 +1201,382 @@ void Context::HookCallback(lua_State *L, lua_Debug *ar) {
 	}
 }
 
-void Context::BeginCoroutine(lua_State *L) {
+void Context::StartProfiler(lldebug_ProfileMode mode, int interval) {
 	scoped_lock lock(m_mutex);
+	bool wasSampling = m_profiler.IsSampling();
 
-	CoroutineInfo info(L);
-	m_coroutines.push_back(info);
+	m_profiler.Start(mode, interval);
+	ResetLineHeats();
+
+	if (wasSampling && !m_profiler.IsSampling()) {
+		ResyncCallCounts();
+	}
 }
 
-void Context::EndCoroutine(lua_State *L) {
+void Context::StopProfiler() {
 	scoped_lock lock(m_mutex);
+	bool wasSampling = m_profiler.IsSampling();
 
-	if (m_coroutines.empty() || m_coroutines.back().L != L) {
-		assert(0 && "Couldn't end coroutine.");
-		return;
+	m_profiler.Stop();
+
+	if (wasSampling) {
+		ResyncCallCounts();
 	}
+}
 
-	// When it goes through the coroutine set break mark,
-	// we force to break.
-	if (m_debugState == DEBUGSTATE_STEPOVER
-		|| m_debugState == DEBUGSTATE_STEPRETURN) {
-		if (m_stepinfo.L == L) {
-			SetDebugState(DEBUGSTATE_BREAK);
+/// Set the call counts to the depths of the stacks.
+/** The call and return hooks aren't called while sampling,
+ * so the counts may be wrong for 'StepOver' and 'StepReturn'.
+ */
+void Context::ResyncCallCounts() {
+	scoped_lock lock(m_mutex);
+
+	CoroutineList::iterator it;
+	for (it = m_coroutines.begin(); it != m_coroutines.end(); ++it) {
+		lua_Debug ar;
+		int depth = 0;
+		while (lua_getstack(it->L, depth, &ar) != 0) {
+			++depth;
+		}
+
+		// The step count is moved too, it's relative to the count.
+		if (m_stepinfo.L == it->L) {
+			m_stepinfo.call += depth - it->call;
 		}
+		it->call = depth;
 	}
+}
 
-	m_coroutines.pop_back();
+std::string Context::DumpProfile(lldebug_ProfileFormat format) {
+	scoped_lock lock(m_mutex);
+
+	return m_profiler.Dump(format);
 }
 
-/**
- * @brief Implementation of lua functions that uses private methods of Context.
- */
-class Context::LuaImpl {
-public:
-	static int atpanic(lua_State *L) {
-		printf("on atpanic: %s\n", lua_tostring(L, -1));
-		return 0;
+int Context::SaveProfile(const std::string &filename,
+						 lldebug_ProfileFormat format) {
+	scoped_lock lock(m_mutex);
+
+	std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+	if (!ofs.is_open()) {
+		return -1;
 	}
 
-	static int lldebug_assert(lua_State *L) {
-		bool iserror = (
-			(lua_isnil(L, 1)) ||
-			(lua_isboolean(L, 1) && lua_toboolean(L, 1)));
+	ofs << m_profiler.Dump(format);
+	return (ofs.good() ? 0 : -1);
+}
 
-		if (iserror) {
-			std::string str =
-				( lua_isstring(L, 2)
-				? lua_tostring(L, 2)
-				: "assertion failed!");
-			luaL_error(L, "%s", str.c_str());
-		}
+void Context::StartCoverage(const std::string &outputFile) {
+	scoped_lock lock(m_mutex);
 
-		return 0;
-	}
+	m_coverage.Start(outputFile);
+	ResetLineHeats();
+}
 
-	static int cocreate(lua_State *L) {
-		shared_ptr<Context> ctx = Context::Find(L);
-		if (ctx == NULL) {
-			luaL_error(L, "The context isn't registered.");
-			return 0;
-		}
+void Context::StopCoverage() {
+	scoped_lock lock(m_mutex);
 
-		lua_State *NL = ctx->NewThread(L);
-		luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1), 1,
-			"Lua function expected");
-		lua_pushvalue(L, 1);  /* move function to top */
-		lua_xmove(L, NL, 1);  /* move function from L to NL */
-		lua_atpanic(NL, atpanic);
-		return 1;
+	m_coverage.Stop();
+}
+
+std::string Context::DumpCoverage() {
+	scoped_lock lock(m_mutex);
+
+	return m_coverage.DumpLcov(m_sourceManager);
+}
+
+int Context::SaveCoverage(const std::string &filename) {
+	scoped_lock lock(m_mutex);
+
+	std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+	if (!ofs.is_open()) {
+		return -1;
 	}
 
-	static int auxresume(lua_State *L, lua_State *co, int narg) {
-		shared_ptr<Context> ctx = Context::Find(L);
+	ofs << m_coverage.DumpLcov(m_sourceManager);
+	return (ofs.good() ? 0 : -1);
+}
 
-		if (!lua_checkstack(co, narg))
-			luaL_error(L, "too many arguments to resume");
-		lua_xmove(L, co, narg);
+/// The frame is told to drop its heats by the new generation.
+void Context::ResetLineHeats() {
+	scoped_lock lock(m_mutex);
 
-		ctx->BeginCoroutine(co);
-		int status = lua_resume(co, narg);
-		ctx->EndCoroutine(co);
+	++m_heatGeneration;
+	m_sentHeats.clear();
+}
 
-		if (status == 0
-#ifdef LUA_YIELD
-			|| status == LUA_YIELD
-#endif
-			) {
-			int nres = lua_gettop(co);
-			if (!lua_checkstack(L, nres))
-				luaL_error(L, "too many results to resume");
-			lua_xmove(co, L, nres);  /* move yielded values */
-			return nres;
+/// Get the heats of the lines changed since they were sent last.
+/** The heats are the samples of the profiler, or 1 for the lines
+ * executed by the coverage if the source wasn't sampled.
+ */
+LuaLineHeatsMap Context::GetLineHeats(const std::vector<int> &sourceIds) {
+	scoped_lock lock(m_mutex);
+	LuaLineHeatsMap result;
+
+	for (size_t i = 0; i < sourceIds.size(); ++i) {
+		const Source *source = m_sourceManager.Get(sourceIds[i]);
+		if (source == NULL) {
+			continue;
 		}
-		else {
-			lua_xmove(co, L, 1);  /* move error message */
-			return -1;  /* error flag */
+
+		const std::vector<int> *samples =
+			m_profiler.GetLineSamples(source->GetKey());
+		const std::vector<bool> *executed =
+			(samples == NULL
+				? m_coverage.GetExecutedLines(source->GetKey())
+				: NULL);
+		size_t size = (samples != NULL ? samples->size()
+			: executed != NULL ? executed->size() : 0);
+
+		LuaLineHeats &sent = m_sentHeats[sourceIds[i]];
+		LuaLineHeats changed;
+		for (size_t line = 1; line < size; ++line) {
+			int heat = (samples != NULL ? (*samples)[line]
+				: ((*executed)[line] ? 1 : 0));
+			if (heat == 0) {
+				continue;
+			}
+
+			int &sentHeat = sent[(int)line];
+			if (heat != sentHeat) {
+				sentHeat = heat;
+				changed[(int)line] = heat;
+			}
+		}
+
+		if (!changed.empty()) {
+			result[sourceIds[i]] = changed;
 		}
 	}
 
-	static int coresume(lua_State *L) {
-		lua_State *co = lua_tothread(L, 1);
+	return result;
+}
 
-		luaL_argcheck(L, co, 1, "coroutine expected");
-		int r = auxresume(L, co, lua_gettop(L) - 1);
+void Context::StartSpans(bool autoSpans, int capacity) {
+	scoped_lock lock(m_mutex);
+
+	m_spans.Start(autoSpans, capacity);
+}
+
+void Context::StopSpans() {
+	scoped_lock lock(m_mutex);
+
+	m_spans.Stop();
+}
+
+void Context::BeginSpan(lua_State *L, const std::string &name) {
+	scoped_lock lock(m_mutex);
+
+	if (m_spans.IsRunning()) {
+		m_spans.BeginSpan(L, name);
+	}
+}
+
+int Context::EndSpan(lua_State *L) {
+	scoped_lock lock(m_mutex);
+
+	if (!m_spans.IsRunning()) {
+		return 0;
+	}
+
+	return m_spans.EndSpan(L);
+}
+
+std::string Context::DumpSpans() {
+	scoped_lock lock(m_mutex);
+
+	return m_spans.DumpChromeTrace();
+}
+
+int Context::SaveSpans(const std::string &filename) {
+	scoped_lock lock(m_mutex);
+
+	std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+	if (!ofs.is_open()) {
+		return -1;
+	}
+
+	ofs << m_spans.DumpChromeTrace();
+	return (ofs.good() ? 0 : -1);
+}
+
+void Context::StartGovernor(double maxOverhead) {
+	scoped_lock lock(m_mutex);
+
+	m_governor.Start(maxOverhead);
+	m_profiler.SetIntervalScale(1);
+}
+
+void Context::StopGovernor() {
+	scoped_lock lock(m_mutex);
+
+	m_governor.Stop();
+	m_profiler.SetIntervalScale(1);
+}
+
+void Context::GetGovernorStatus(double &overhead, int &level) {
+	scoped_lock lock(m_mutex);
+
+	overhead = m_governor.GetOverhead();
+	level = m_governor.GetLevel();
+}
+
+/// The coroutine(idx) was created by the function running in 'L'.
+void Context::CreateCoroutine(lua_State *L, int idx) {
+	scoped_lock lock(m_mutex);
+
+	lua_State *co = lua_tothread(L, idx);
+	llutil_markthread(L, idx);
+	m_profiler.OnCreateCoroutine(L, co);
+
+	// The address of the collected coroutine may be reused.
+	m_spans.ForgetThread(co);
+
+	// The profiler and the spans forget the collected coroutines,
+	// they may be found only through the weak table.
+	// The main thread and the running ones aren't marked.
+	if (m_profiler.IsPruneNeeded() || m_spans.IsPruneNeeded()) {
+		std::set<lua_State *> alive;
+		llutil_getmarkedthreads(L, alive);
+		alive.insert(GetLua());
+		CoroutineList::iterator it;
+		for (it = m_coroutines.begin(); it != m_coroutines.end(); ++it) {
+			alive.insert(it->L);
+		}
+
+		m_profiler.PruneCoroutines(alive);
+		m_spans.PruneThreads(alive);
+	}
+}
+
+/// The coroutine(idx) is resumed in 'L'.
+/** The coroutines that weren't created by 'coroutine.create'
+ * are also marked while tracing or recording the spans.
+ */
+void Context::MarkCoroutine(lua_State *L, int idx) {
+	scoped_lock lock(m_mutex);
+
+	if (m_profiler.IsTracing() || m_spans.IsRunning()) {
+		llutil_markthread(L, idx);
+	}
+}
+
+void Context::BeginCoroutine(lua_State *L) {
+	scoped_lock lock(m_mutex);
+
+	if (m_profiler.IsRunning() && !m_coroutines.empty()) {
+		m_profiler.BeginCoroutine(m_coroutines.back().L, L);
+	}
+
+	CoroutineInfo info(L);
+	m_coroutines.push_back(info);
+}
+
+void Context::EndCoroutine(lua_State *L) {
+	scoped_lock lock(m_mutex);
+
+	if (m_coroutines.empty() || m_coroutines.back().L != L) {
+		assert(0 && "Couldn't end coroutine.");
+		return;
+	}
+
+	// When it goes through the coroutine set break mark,
+	// we force to break.
+	if (m_debugState == DEBUGSTATE_STEPOVER
+		|| m_debugState == DEBUGSTATE_STEPRETURN) {
+		if (m_stepinfo.L == L) {
+			SetDebugState(DEBUGSTATE_BREAK);
+		}
+	}
+
+	m_coroutines.pop_back();
+
+	if (m_profiler.IsRunning() && !m_coroutines.empty()) {
+		m_profiler.EndCoroutine(m_coroutines.back().L, L);
+	}
+}
+
+/**
+ * @brief Implementation of lua functions that uses private methods of Context.
+ */
+class Context::LuaImpl {
+public:
+	static int atpanic(lua_State *L) {
+		printf("on atpanic: %s\n", lua_tostring(L, -1));
+		return 0;
+	}
+
+	static int lldebug_assert(lua_State *L) {
+		bool iserror = (
+			(lua_isnil(L, 1)) ||
+			(lua_isboolean(L, 1) && lua_toboolean(L, 1)));
+
+		if (iserror) {
+			std::string str =
+				( lua_isstring(L, 2)
+				? lua_tostring(L, 2)
+				: "assertion failed!");
+			luaL_error(L, "%s", str.c_str());
+		}
+
+		return 0;
+	}
+
+	static int cocreate(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		lua_State *NL = ctx->NewThread(L);
+		luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1), 1,
+			"Lua function expected");
+		lua_pushvalue(L, 1);  /* move function to top */
+		lua_xmove(L, NL, 1);  /* move function from L to NL */
+		lua_atpanic(NL, atpanic);
+		ctx->CreateCoroutine(L, -1);
+		return 1;
+	}
+
+	static int auxresume(lua_State *L, lua_State *co, int narg) {
+		shared_ptr<Context> ctx = Context::Find(L);
+
+		if (!lua_checkstack(co, narg))
+			luaL_error(L, "too many arguments to resume");
+		lua_xmove(L, co, narg);
+
+		ctx->BeginCoroutine(co);
+		int status = lua_resume(co, narg);
+		ctx->EndCoroutine(co);
+
+		if (status == 0
+#ifdef LUA_YIELD
+			|| status == LUA_YIELD
+#endif
+			) {
+			int nres = lua_gettop(co);
+			if (!lua_checkstack(L, nres))
+				luaL_error(L, "too many results to resume");
+			lua_xmove(co, L, nres);  /* move yielded values */
+			return nres;
+		}
+		else {
+			lua_xmove(co, L, 1);  /* move error message */
+			return -1;  /* error flag */
+		}
+	}
+
+	static int coresume(lua_State *L) {
+		lua_State *co = lua_tothread(L, 1);
+
+		luaL_argcheck(L, co, 1, "coroutine expected");
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx != NULL) {
+			ctx->MarkCoroutine(L, 1);
+		}
+
+		int r = auxresume(L, co, lua_gettop(L) - 1);
 		if (r < 0) {
 			lua_pushboolean(L, 0);
 			lua_insert(L, -2);
@@ -994,6 +1589,311 @@ public:
 		}
 	}
 
+	static lldebug_ProfileMode checkprofilemode(lua_State *L, int narg) {
+		static const struct {
+			const char *name;
+			lldebug_ProfileMode mode;
+		} s_modes[] = {
+			{"sampling", LLDEBUG_PROFILEMODE_SAMPLING},
+			{"tracing", LLDEBUG_PROFILEMODE_TRACING},
+			{"instructions", LLDEBUG_PROFILEMODE_INSTRUCTIONS},
+			{NULL, LLDEBUG_PROFILEMODE_SAMPLING}
+		};
+
+		const char *name = luaL_optstring(L, narg, "sampling");
+		for (int i = 0; s_modes[i].name != NULL; ++i) {
+			if (strcmp(s_modes[i].name, name) == 0) {
+				return s_modes[i].mode;
+			}
+		}
+
+		luaL_argerror(L, narg,
+			lua_pushfstring(L, "invalid profile mode '%s'", name));
+		return LLDEBUG_PROFILEMODE_SAMPLING;
+	}
+
+	static lldebug_ProfileFormat checkprofileformat(lua_State *L, int narg) {
+		static const struct {
+			const char *name;
+			lldebug_ProfileFormat format;
+		} s_formats[] = {
+			{"calltree", LLDEBUG_PROFILEFORMAT_CALLTREE},
+			{"functions", LLDEBUG_PROFILEFORMAT_FUNCTIONS},
+			{"callgrind", LLDEBUG_PROFILEFORMAT_CALLGRIND},
+			{"folded", LLDEBUG_PROFILEFORMAT_FOLDED},
+			{NULL, LLDEBUG_PROFILEFORMAT_CALLTREE}
+		};
+
+		const char *name = luaL_optstring(L, narg, "calltree");
+		for (int i = 0; s_formats[i].name != NULL; ++i) {
+			if (strcmp(s_formats[i].name, name) == 0) {
+				return s_formats[i].format;
+			}
+		}
+
+		luaL_argerror(L, narg,
+			lua_pushfstring(L, "invalid profile format '%s'", name));
+		return LLDEBUG_PROFILEFORMAT_CALLTREE;
+	}
+
+	/// lldebug.start_profiler([mode [, interval]])
+	/** 'mode' is "sampling", "tracing" or "instructions",
+	 * the default interval of the mode is used if 'interval' is nil.
+	 */
+	static int start_profiler(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		lldebug_ProfileMode mode = checkprofilemode(L, 1);
+		ctx->StartProfiler(mode,
+			luaL_optint(L, 2, 0));
+		return 0;
+	}
+
+	/// lldebug.stop_profiler()
+	static int stop_profiler(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->StopProfiler();
+		return 0;
+	}
+
+	/// lldebug.dump_profile([filename [, format]])
+	/** It returns the profile string if 'filename' is nil.
+	 */
+	static int dump_profile(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		lldebug_ProfileFormat format = checkprofileformat(L, 2);
+		if (lua_isnoneornil(L, 1)) {
+			std::string str = ctx->DumpProfile(format);
+			lua_pushlstring(L, str.c_str(), str.length());
+			return 1;
+		}
+
+		const char *filename = luaL_checkstring(L, 1);
+		if (ctx->SaveProfile(filename, format) != 0) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "Couldn't write the profile to '%s'.", filename);
+			return 2;
+		}
+
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	/// lldebug.start_coverage([filename])
+	/** The coverage is written to 'filename' when the context is closed.
+	 */
+	static int start_coverage(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->StartCoverage(luaL_optstring(L, 1, ""));
+		return 0;
+	}
+
+	/// lldebug.stop_coverage()
+	static int stop_coverage(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->StopCoverage();
+		return 0;
+	}
+
+	/// lldebug.dump_coverage([filename])
+	/** It returns the lcov string if 'filename' is nil.
+	 */
+	static int dump_coverage(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		if (lua_isnoneornil(L, 1)) {
+			std::string str = ctx->DumpCoverage();
+			lua_pushlstring(L, str.c_str(), str.length());
+			return 1;
+		}
+
+		const char *filename = luaL_checkstring(L, 1);
+		if (ctx->SaveCoverage(filename) != 0) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "Couldn't write the coverage to '%s'.", filename);
+			return 2;
+		}
+
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	/// lldebug.start_spans([auto [, capacity]])
+	/** The calls of the functions are the spans too if 'auto' is true.
+	 */
+	static int start_spans(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->StartSpans(lua_toboolean(L, 1) != 0,
+			luaL_optint(L, 2, LLDEBUG_DEFAULT_SPANCAPACITY));
+		return 0;
+	}
+
+	/// lldebug.stop_spans()
+	static int stop_spans(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->StopSpans();
+		return 0;
+	}
+
+	/// lldebug.span_begin(name)
+	static int span_begin(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->BeginSpan(L, luaL_checkstring(L, 1));
+		return 0;
+	}
+
+	/// lldebug.span_end()
+	/** It returns false if there is no span to end.
+	 */
+	static int span_end(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		lua_pushboolean(L, ctx->EndSpan(L) == 0);
+		return 1;
+	}
+
+	/// lldebug.dump_spans([filename])
+	/** It returns the chrome trace string if 'filename' is nil.
+	 */
+	static int dump_spans(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		if (lua_isnoneornil(L, 1)) {
+			std::string str = ctx->DumpSpans();
+			lua_pushlstring(L, str.c_str(), str.length());
+			return 1;
+		}
+
+		const char *filename = luaL_checkstring(L, 1);
+		if (ctx->SaveSpans(filename) != 0) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "Couldn't write the spans to '%s'.", filename);
+			return 2;
+		}
+
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	/// lldebug.start_governor([max_overhead])
+	/** 'max_overhead' is the limit (%) of the time in the hooks.
+	 */
+	static int start_governor(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->StartGovernor(luaL_optnumber(L, 1, LLDEBUG_DEFAULT_MAXOVERHEAD));
+		return 0;
+	}
+
+	/// lldebug.stop_governor()
+	static int stop_governor(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		ctx->StopGovernor();
+		return 0;
+	}
+
+	/// lldebug.get_overhead()
+	/** It returns the overhead (%) measured by the governor
+	 * and the scale of the interval of the count hook.
+	 */
+	static int get_overhead(lua_State *L) {
+		shared_ptr<Context> ctx = Context::Find(L);
+		if (ctx == NULL) {
+			luaL_error(L, "The context isn't registered.");
+			return 0;
+		}
+
+		double overhead;
+		int level;
+		ctx->GetGovernorStatus(overhead, level);
+		lua_pushnumber(L, overhead);
+		lua_pushnumber(L, (lua_Number)(1 << level));
+		return 2;
+	}
+
+	static void open_profiler(lua_State *L) {
+		const luaL_reg s_profregs[] = {
+			{"start_profiler", LuaImpl::start_profiler},
+			{"stop_profiler", LuaImpl::stop_profiler},
+			{"dump_profile", LuaImpl::dump_profile},
+			{"start_coverage", LuaImpl::start_coverage},
+			{"stop_coverage", LuaImpl::stop_coverage},
+			{"dump_coverage", LuaImpl::dump_coverage},
+			{"start_spans", LuaImpl::start_spans},
+			{"stop_spans", LuaImpl::stop_spans},
+			{"span_begin", LuaImpl::span_begin},
+			{"span_end", LuaImpl::span_end},
+			{"dump_spans", LuaImpl::dump_spans},
+			{"start_governor", LuaImpl::start_governor},
+			{"stop_governor", LuaImpl::stop_governor},
+			{"get_overhead", LuaImpl::get_overhead},
+			{NULL, NULL}
+		};
+
+		luaL_openlib(L, LUA_LLDEBUGLIBNAME, s_profregs, 0);
+		lua_pop(L, 1);
+	}
+
 	static void override_baselib(lua_State *L) {
 		const luaL_reg s_coregs[] = {
 			{"create", LuaImpl::cocreate},
@@ -1010,6 +1910,11 @@ int Context::LuaInitialize(lua_State *L) {
 	lua_atpanic(L, LuaImpl::atpanic);
 //	lua_register(L, "lldebug_atpanic", LuaImpl::atpanic);
 	luaopen_lldebug(L);
+	LuaImpl::open_profiler(L);
+
+	// The span functions themselves aren't the automatic spans.
+	m_spans.IgnoreFunc(LuaImpl::span_begin);
+	m_spans.IgnoreFunc(LuaImpl::span_end);
 	return 0;
 }
 
@@ -1120,7 +2025,7 @@ lua_State *Context::NewThread(lua_State *L) {
 	lua_State *NL = lua_newthread(L);
 
 	// Set the hook function to NL.
-	Context::SetHook(NL);
+	ctx->SetHook(NL);
 
 	// Connect the context of L with NL.
 	Context::ms_manager->Add(ctx, NL);
@@ -1210,11 +2115,26 @@ int Context::Resume(lua_State *L, int nargs) {
 
 
 /*-----------------------------------------------------------------*/
-LuaVarList Context::LuaGetGlobals() {
+/// Is the value formatter the native default ?
+/** The result is cached until the next update, so that making
+ * many LuaVar objects doesn't look up the 'lldebug' table every time.
+ */
+bool Context::IsNativeFormatter() {
+	scoped_lock lock(m_mutex);
+
+	if (m_formatterUpdateCount != m_updateCount) {
+		m_isNativeFormatter = llutil_isnativeformatter(GetLua());
+		m_formatterUpdateCount = m_updateCount;
+	}
+
+	return m_isNativeFormatter;
+}
+
+LuaVarList Context::LuaGetGlobals(const LuaVarFilter &filter) {
 	scoped_lock lock(m_mutex);
 
 	// Get the fields of the global table.
-	varlist_maker callback;
+	varlist_maker callback(IsNativeFormatter(), m_previewLength, filter);
 	if (iterate_fields(callback, GetLua(), LUA_GLOBALSINDEX) != 0) {
 		return LuaVarList();
 	}
@@ -1222,11 +2142,11 @@ LuaVarList Context::LuaGetGlobals() {
 	return callback.get_result();
 }
 
-LuaVarList Context::LuaGetRegistories() {
+LuaVarList Context::LuaGetRegistories(const LuaVarFilter &filter) {
 	scoped_lock lock(m_mutex);
 
 	// Get the fields of the registory table.
-	varlist_maker callback;
+	varlist_maker callback(IsNativeFormatter(), m_previewLength, filter);
 	if (iterate_fields(callback, GetLua(), LUA_REGISTRYINDEX) != 0) {
 		return LuaVarList();
 	}
@@ -1234,25 +2154,137 @@ LuaVarList Context::LuaGetRegistories() {
 	return callback.get_result();
 }
 
-LuaVarList Context::LuaGetFields(const LuaVar &var) {
+LuaVarList Context::LuaGetFields(const LuaVarRef &ref, int updateCount,
+								  const LuaVarFilter &filter) {
 	scoped_lock lock(m_mutex);
 
+	// The frame discards the result of the old request,
+	// so we needn't iterate the fields.
+	if (updateCount < m_updateCount) {
+		return LuaVarList();
+	}
+
 	// Get the fields of var.
-	varlist_maker callback;
-	if (iterate_var(callback, var) != 0) {
+	varlist_maker callback(IsNativeFormatter(), m_previewLength, filter);
+	if (iterate_var(callback, ref) != 0) {
 		return LuaVarList();
 	}
 
 	return callback.get_result();
 }
 
+/// The list whose vars' fields are prefetched.
+struct PrefetchLevel {
+	explicit PrefetchLevel(const LuaVarList *vars_, int first_, int depth_)
+		: vars(vars_), first(first_), depth(depth_) {
+	}
+	const LuaVarList *vars;
+	int first; ///< the number of the first var
+	int depth;
+};
+
+/// Get the fields of the vars that have them, while the size is in the budget.
+/** The frame expands nested tables without waiting for the next request.
+ * The fields are prefetched breadth first up to 'prefetchDepth' levels.
+ * The key of the result is the number of the var whose fields it has.
+ * The vars are numbered in order, from 'vars' to the prefetched lists
+ * in the order of their keys.
+ */
+LuaVarListMap Context::LuaPrefetchFields(const LuaVarList &vars,
+										 const LuaVarFilter &filter,
+										 int prefetchBytes,
+										 int prefetchDepth) {
+	scoped_lock lock(m_mutex);
+	LuaVarListMap result;
+	std::set<int> prefetchedTables;
+	int bytes = 0;
+
+	std::queue<PrefetchLevel> levels;
+	levels.push(PrefetchLevel(&vars, 0, 1));
+	int next = (int)vars.size();
+
+	while (!levels.empty() && prefetchDepth > 0) {
+		PrefetchLevel level = levels.front();
+		levels.pop();
+
+		for (LuaVarList::size_type i = 0; i < level.vars->size(); ++i) {
+			const LuaVar &var = (*level.vars)[i];
+			if (!var.HasFields() || !var.GetRef().IsOk()) {
+				continue;
+			}
+
+			// The recursive tables are prefetched only once.
+			int tableIdx = var.GetRef().GetTableIdx();
+			if (!prefetchedTables.insert(tableIdx).second) {
+				continue;
+			}
+
+			// The size is estimated by the strings and the fixed overhead
+			// of the reference and the type. The iteration is stopped
+			// as soon as the rest of the budget is exceeded.
+			int rest = prefetchBytes - bytes - LLDEBUG_VARLIST_VAROVERHEAD;
+			if (rest < 0) {
+				return result;
+			}
+
+			varlist_maker callback(
+				IsNativeFormatter(), m_previewLength, filter, rest);
+			if (iterate_var(callback, var.GetRef()) != 0) {
+				if (callback.get_bytes() > rest) {
+					return result;
+				}
+				continue;
+			}
+
+			// The map's values aren't moved, so the level can refer to it.
+			LuaVarList &fields = result[level.first + (int)i];
+			fields = callback.get_result();
+			bytes += callback.get_bytes() + LLDEBUG_VARLIST_VAROVERHEAD;
+
+			if (level.depth < prefetchDepth) {
+				levels.push(PrefetchLevel(&fields, next, level.depth + 1));
+			}
+			next += (int)fields.size();
+		}
+	}
+
+	return result;
+}
+
+std::string Context::LuaGetVarValue(const LuaVarRef &ref, int updateCount,
+									int offset, int length) {
+	lua_State *L = ref.GetLua().GetState();
+	if (L == NULL) L = GetLua();
+	scoped_lock lock(m_mutex);
+	scoped_lua scoped(this, L);
+
+	// The kept values were released at the new update.
+	if (updateCount < m_updateCount) {
+		scoped.check(0);
+		return std::string("");
+	}
+
+	if (llutil_pushkeptvalue(L, ref.GetValueIdx()) != 0) {
+		scoped.check(0);
+		return std::string("");
+	}
+
+	int valueLength;
+	std::string str = llutil_tostring_for_varslice(
+		L, lua_gettop(L), IsNativeFormatter(), offset, length, valueLength);
+	lua_pop(L, 1);
+	scoped.check(0);
+	return str;
+}
+
 LuaVarList Context::LuaGetLocals(const LuaStackFrame &stackFrame,
 								 bool checkLocal, bool checkUpvalue,
-								 bool checkEnviron) {
+								 bool checkEnviron,
+								 const LuaVarFilter &filter) {
 	scoped_lock lock(m_mutex);
 	lua_State *L = stackFrame.GetLua().GetState();
 	
-	varlist_maker callback;
+	varlist_maker callback(IsNativeFormatter(), m_previewLength, filter);
 	if (iterate_locals(
 		callback,
 		(L != NULL ? L : GetLua()),
@@ -1267,7 +2299,7 @@ LuaVarList Context::LuaGetLocals(const LuaStackFrame &stackFrame,
 LuaVarList Context::LuaGetStack() {
 	scoped_lock lock(m_mutex);
 
-	varlist_maker callback;
+	varlist_maker callback(IsNativeFormatter(), m_previewLength);
 	if (iterate_stacks(callback, GetLua()) != 0) {
 		return LuaVarList();
 	}
@@ -1296,17 +2328,13 @@ LuaBacktraceList Context::LuaGetBacktrace() {
 
 			lua_getinfo(L1, "Snl", &ar);
 
-			// Source title is also set,
-			// because it is always used when backtrace is shown.
-			std::string sourceTitle;
+			// Only the source id is sent, the frame knows its title.
 			const Source *source = m_sourceManager.Get(ar.source);
-			if (source != NULL) {
-				sourceTitle = source->GetTitle();
-			}
+			int sourceId = (source != NULL ? source->GetId() : -1);
 
 			std::string name = llutil_makefuncname(&ar);
 			array.push_back(LuaBacktrace(
-				L1, name, ar.source, sourceTitle,
+				L1, name, sourceId,
 				ar.currentline, level));
 		}
 
@@ -1316,22 +2344,68 @@ LuaBacktraceList Context::LuaGetBacktrace() {
 	return array;
 }
 
+/// Push the thread 'L1' onto 'L' as the target of the eval.
+/** The thread value keeps 'L1' alive,
+ * but lua 5.0 can't push it and uses the light userdata instead.
+ */
+static void push_thread_for_eval(lua_State *L, lua_State *L1) {
+#ifdef LUA_VERSION_NUM
+	lua_pushthread(L1);
+	lua_xmove(L1, L, 1);
+#else
+	lua_pushlightuserdata(L, L1);
+#endif
+}
+
+/// Get the target thread of the eval.
+static lua_State *to_thread_for_eval(lua_State *L, int idx) {
+	if (lua_type(L, idx) == LUA_TTHREAD) {
+		return lua_tothread(L, idx);
+	}
+
+	return (lua_State *)lua_touserdata(L, idx);
+}
+
+/// Push the name index of the locals of the target function.
+/** The upvalue(2) is the holder table shared by __index and __newindex,
+ * so the index is made only once per env.
+ */
+static void push_localindex_for_eval(lua_State *L, lua_State *L1, int level) {
+	lua_rawgeti(L, lua_upvalueindex(2), 1);
+	if (lua_istable(L, -1)) {
+		return;
+	}
+	lua_pop(L, 1);
+
+	make_localindex(L1, level);
+	lua_xmove(L1, L, 1);
+	lua_pushvalue(L, -1);
+	lua_rawseti(L, lua_upvalueindex(2), 1);
+}
+
 static int index_for_eval(lua_State *L) {
 	scoped_lua scoped(L);
 	std::string target(luaL_checkstring(L, 2));
 	int level = (int)lua_tonumber(L, lua_upvalueindex(1));
+	lua_State *L1 = to_thread_for_eval(L, lua_upvalueindex(3));
 
 	// level 0: this C function
-	// level 1: __lldebug_dummy__ function
-	// level 2: loaded string in LuaEval (includes __lldebug_dummy__)
-	// level 3: current running function
+	// level 1: the cached eval function
 	if (find_localvalue(L, 1, target, true, true, false) == 0) {
 		return scoped.check(1);
 	}
 
-	if (find_localvalue(L, level + 3, target, true, true, true) == 0) {
+	// The locals of the target are read on its own thread,
+	// and the index and the value are moved between the threads.
+	push_localindex_for_eval(L, L1, level);
+	lua_xmove(L, L1, 1);
+	int indexIdx = lua_gettop(L1);
+	if (find_indexedvalue(L1, level, indexIdx, target, true) == 0) {
+		lua_remove(L1, indexIdx);
+		lua_xmove(L1, L, 1);
 		return scoped.check(1);
 	}
+	lua_pop(L1, 1);
 
 	lua_pushnil(L);
 	return scoped.check(1); // return nil
@@ -1341,66 +2415,111 @@ static int newindex_for_eval(lua_State *L) {
 	scoped_lua scoped(L);
 	std::string target(lua_tostring(L, 2));
 	int level = (int)lua_tonumber(L, lua_upvalueindex(1));
+	lua_State *L1 = to_thread_for_eval(L, lua_upvalueindex(3));
 	
 	// level 0: this C function
-	// level 1: __lldebug_dummy__ function
-	// level 2: loaded string in LuaEval (includes __lldebug_dummy__)
-	// level 3: current running function
+	// level 1: the cached eval function
 	if (set_localvalue(L, 1, target, 3, true, true, false, false) == 0) {
 		return scoped.check(0);
 	}
 
-	if (set_localvalue(L, level + 3, target, 3, true, true, true, false) == 0) {
+	// index, value
+	push_localindex_for_eval(L, L1, level);
+	lua_pushvalue(L, 3);
+	lua_xmove(L, L1, 2);
+	int indexIdx = lua_gettop(L1) - 1;
+	if (set_indexedvalue(L1, level, indexIdx, target, -1, true) == 0) {
+		lua_pop(L1, 2);
 		return scoped.check(0);
 	}
+	lua_pop(L1, 2);
 
 	luaL_error(L, "Variable '%s' doesn't exist here.", lua_tostring(L, 2));
 	return scoped.check(0);
 }
 
-static int setmetatable_for_eval(lua_State *L) {
+static int getlocals_for_eval(lua_State *L) {
 	scoped_lua scoped(L);
-
-	// level 0: this C function
-	// level 1: __lldebug_dummy__ function
-	// level 2: loaded string in LuaEval (includes __lldebug_dummy__)
-	// level 3: current running function
 	int level = (int)luaL_checknumber(L, lua_upvalueindex(1));
+	lua_State *L1 = to_thread_for_eval(L, lua_upvalueindex(2));
+	int n = lua_gettop(L);
+	bool checkLocal =
+		(n >= 1 && lua_isboolean(L, 1) ? (lua_toboolean(L, 1) != 0) : true);
+	bool checkUpvalue =
+		(n >= 2 && lua_isboolean(L, 2) ? (lua_toboolean(L, 2) != 0) : true);
+	bool checkEnv =
+		(n >= 3 && lua_isboolean(L, 3) ? (lua_toboolean(L, 3) != 0) : false);
+
+	int ret = llutil_getlocals(L1, level, checkLocal, checkUpvalue, checkEnv);
+	lua_xmove(L1, L, ret);
+	return scoped.check(ret);
+}
 
+/// Push the env table of the eval functions,
+/// which sees the locals at 'level' of the thread 'L1'.
+static void push_env_for_eval(lua_State *L, lua_State *L1, int level) {
 	// table = {}, meta = {}
 	lua_newtable(L);
 	lua_newtable(L);
 	int meta = lua_gettop(L);
 
+	// The holder of the name index, which is made at the first access.
+	lua_newtable(L);
+	int holder = lua_gettop(L);
+
 	// meta.__index = func1; meta.__newindex = func2
 	lua_pushliteral(L, "__index");
 	lua_pushnumber(L, (lua_Number)level);
-	lua_pushcclosure(L, index_for_eval, 1);
+	lua_pushvalue(L, holder);
+	push_thread_for_eval(L, L1);
+	lua_pushcclosure(L, index_for_eval, 3);
 	lua_rawset(L, meta);
 	lua_pushliteral(L, "__newindex");
 	lua_pushnumber(L, (lua_Number)level);
-	lua_pushcclosure(L, newindex_for_eval, 1);
+	lua_pushvalue(L, holder);
+	push_thread_for_eval(L, L1);
+	lua_pushcclosure(L, newindex_for_eval, 3);
 	lua_rawset(L, meta);
+	lua_pop(L, 1); // Eliminate the holder.
 
-	// setfenv(1, setmetatable({}, meta))
+	// setmetatable({}, meta)
 	lua_setmetatable(L, -2);
-	llutil_setfenv(L, 1, -1);
-	lua_pop(L, 1);
-	return scoped.check(0);
 }
 
-static int getlocals_for_eval(lua_State *L) {
+/// Prepare the environment of the cached eval function.
+/** It's called as
+ * 'local lldebug, getlocals = __lldebug_prepare__(thread, level, env)'.
+ * The level is of the target thread, which isn't the running one.
+ * If 'env' isn't given, a new env table is made for the level.
+ */
+static int prepare_for_eval(lua_State *L) {
 	scoped_lua scoped(L);
-	int level = (int)luaL_checknumber(L, lua_upvalueindex(1));
-	int n = lua_gettop(L);
-	bool checkLocal =
-		(n >= 1 && lua_isboolean(L, 1) ? (lua_toboolean(L, 1) != 0) : true);
-	bool checkUpvalue =
-		(n >= 2 && lua_isboolean(L, 2) ? (lua_toboolean(L, 2) != 0) : true);
-	bool checkEnv =
-		(n >= 3 && lua_isboolean(L, 3) ? (lua_toboolean(L, 3) != 0) : false);
+	lua_State *L1 = to_thread_for_eval(L, 1);
+	int level = (int)luaL_checknumber(L, 2);
 
-	return llutil_getlocals(L, level + 3, checkLocal, checkUpvalue, checkEnv);
+	if (L1 == NULL) {
+		luaL_error(L, "The thread of the eval isn't given.");
+	}
+
+	// setfenv(1, env)
+	// The env is set at every call,
+	// so the cached function never sees the old level.
+	if (lua_istable(L, 3)) {
+		lua_pushvalue(L, 3);
+	}
+	else {
+		push_env_for_eval(L, L1, level);
+	}
+	llutil_setfenv(L, 1, -1);
+	lua_pop(L, 1);
+
+	// return lldebug, getlocals
+	lua_pushliteral(L, "lldebug");
+	lua_rawget(L, LUA_GLOBALSINDEX);
+	lua_pushnumber(L, (lua_Number)level);
+	lua_pushvalue(L, 1);
+	lua_pushcclosure(L, getlocals_for_eval, 2);
+	return scoped.check(2);
 }
 
 /**
@@ -1448,7 +2567,192 @@ struct eval_string_reader {
 	}
 	};
 
-int Context::LuaEval(lua_State *L, int level, const std::string &str, bool withDebug) {
+/// Compile the eval string and push the function.
+/** If 'withLevel' is true, the function takes the stack level
+ * as its argument and can see the local vars there.
+ */
+static int load_for_eval(lua_State *L, const std::string &str, bool withLevel) {
+	scoped_lua scoped(L);
+	const char *beginning = NULL;
+	const char *ending = NULL;
+
+	if (withLevel) {
+		// The names of the locals and upvalues here hide the user's ones,
+		// so the level is passed as '...' and never named.
+		beginning =
+			"local __lldebug_prepare__ = ...\n"
+			"return function(...)\n"
+			"  local lldebug, getlocals = __lldebug_prepare__(...)\n";
+		ending =
+			"\nend";
+	}
+
+	// Load string (use lua_load).
+	eval_string_reader reader(str, beginning, ending);
+	if (lua_load(L, eval_string_reader::exec, &reader, DUMMY_FUNCNAME) != 0) {
+		scoped.check(1);
+		return -1;
+	}
+
+	if (withLevel) {
+		// Functions used here are given as the upvalue
+		// because of preparation for error state like that
+		// all basic functions are unusable.
+		lua_pushcfunction(L, prepare_for_eval);
+		if (lua_pcall(L, 1, 1, 0) != 0) {
+			scoped.check(1);
+			return -1;
+		}
+	}
+
+	scoped.check(1);
+	return 0;
+}
+
+/**
+ * @brief Limits the eval by the budget while this object is alive.
+ *
+ * The count hook is installed on the thread of each eval by LuaEval,
+ * because the hooks of 'L' don't work while its hook is running.
+ * Only the outermost scope sets the budget.
+ */
+class Context::EvalBudgetScope {
+public:
+	explicit EvalBudgetScope(Context *ctx, lua_State * /*L*/,
+							 const LuaEvalBudget &budget)
+		: m_ctx(ctx), m_isInstalled(false) {
+		scoped_lock lock(ctx->m_mutex);
+
+		if (ctx->m_evalDepth++ > 0 || budget.IsUnlimited()) {
+			return;
+		}
+
+		ctx->m_evalBudget = budget;
+		ctx->m_evalInstructions = 0;
+		boost::xtime_get(&ctx->m_evalEnd, boost::TIME_UTC);
+		if (budget.GetTimeout() >= 0) {
+			ctx->m_evalEnd.sec += budget.GetTimeout() / 1000;
+			ctx->m_evalEnd.nsec += (budget.GetTimeout() % 1000) * 1000 * 1000;
+			if (ctx->m_evalEnd.nsec >= 1000 * 1000 * 1000) {
+				ctx->m_evalEnd.nsec -= 1000 * 1000 * 1000;
+				++ctx->m_evalEnd.sec;
+			}
+		}
+
+		ctx->m_hasEvalBudget = true;
+		m_isInstalled = true;
+	}
+
+	~EvalBudgetScope() {
+		scoped_lock lock(m_ctx->m_mutex);
+
+		if (m_isInstalled) {
+			m_ctx->m_hasEvalBudget = false;
+		}
+		--m_ctx->m_evalDepth;
+	}
+
+private:
+	Context *m_ctx;
+	bool m_isInstalled;
+};
+
+/// Apply the level of the governor to the hooks.
+/** The hooks of the other lua_State objects are changed
+ * at their first events.
+ */
+void Context::ApplyGovernor(lua_State *L) {
+	scoped_lock lock(m_mutex);
+
+	m_profiler.SetIntervalScale(1 << m_governor.GetLevel());
+	SetHook(L);
+}
+
+int Context::s_CountHookCallback(lua_State *L, char *message, size_t size) {
+	shared_ptr<Context> ctx = Context::Find(L);
+
+	if (ctx == NULL) {
+		return 0;
+	}
+
+	return ctx->CountHookCallback(L, message, size);
+}
+
+/// Check the eval budget, or take a sample of the profiler.
+/** It returns -1 and makes the error message if the eval must be aborted.
+ */
+int Context::CountHookCallback(lua_State *L, char *message, size_t size) {
+	scoped_lock lock(m_mutex);
+
+	if (m_evalDepth > 0) {
+		return CheckEvalBudget(message, size);
+	}
+
+	GovernorScope governorScope(this, L);
+
+	// The hook of the old mode is changed at the first event.
+	if (!m_profiler.IsSampling()) {
+		SetHook(L);
+		return 0;
+	}
+
+	// The lua functions called by the debugger itself aren't sampled.
+	// The sample is weighted by the count that actually elapsed,
+	// which may be of the old level of the governor.
+	if (m_isEnabled) {
+		m_profiler.Sample(L, lua_gethookcount(L));
+	}
+
+	// The count of the old level is changed after the sample.
+	if (lua_gethookmask(L) != GetHookMask()
+		|| lua_gethookcount(L) != m_profiler.GetSampleInterval()) {
+		SetHook(L);
+	}
+
+	// The line hook isn't called while sampling,
+	// so the commands from the frame are handled here.
+	if (!m_readCommands.empty()) {
+		HandleCommand();
+	}
+
+	return 0;
+}
+
+/// Check the budget of the running eval.
+/** It returns -1 and makes the error message if the eval must be aborted.
+ */
+int Context::CheckEvalBudget(char *message, size_t size) {
+	scoped_lock lock(m_mutex);
+
+	if (m_evalDepth == 0) {
+		return 0;
+	}
+
+	m_evalInstructions += LLDEBUG_EVALBUDGET_STEP;
+	int maxInstructions = m_evalBudget.GetMaxInstructions();
+	if (maxInstructions >= 0 && m_evalInstructions > maxInstructions) {
+		snprintf(message, size,
+			"The eval was aborted, it exceeded %d instructions.",
+			maxInstructions);
+		return -1;
+	}
+
+	if (m_evalBudget.GetTimeout() >= 0) {
+		boost::xtime current;
+		boost::xtime_get(&current, boost::TIME_UTC);
+		if (boost::xtime_cmp(current, m_evalEnd) >= 0) {
+			snprintf(message, size,
+				"The eval was aborted, it exceeded %d msec.",
+				m_evalBudget.GetTimeout());
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int Context::LuaEval(lua_State *L, int level, const std::string &str,
+					 bool withDebug, int envIdx) {
 	scoped_lock lock(m_mutex);
 	scoped_lua scoped(this, L, withDebug);
 
@@ -1456,55 +2760,69 @@ int Context::LuaEval(lua_State *L, int level, const std::string &str, bool withD
 		return 0;
 	}
 
-	const char *beginning = NULL;
-	const char *ending = NULL;
-	if (level >= 0) {
-		beginning =
-			"return (function()\n"
-			"  local lldebug = lldebug\n"
-			"  local getlocals = __lldebug_getlocals__\n"
-			"  __lldebug_setmetatable__()\n";
-		ending =
-			"\nend)()";
+	// The level is given as the argument,
+	// so the compiled function is shared by all levels.
+	std::string key = (level >= 0 ? "L:" : "G:") + str;
+	if (llutil_pushevalchunk(L, key) != 0) {
+		if (load_for_eval(L, str, level >= 0) != 0) {
+			scoped.check(1);
+			return -1;
+		}
 
-		// Export functions used here because of preparation for error state
-		// like that all basic functions are unusable.
+		llutil_cacheevalchunk(L, key, -1, LLDEBUG_EVALCACHE_SIZE);
+	}
 
-		// globals[__lldebug_setmetatable__] = function
-		lua_pushliteral(L, "__lldebug_setmetatable__");
-		lua_pushnumber(L, (lua_Number)level);
-		lua_pushcclosure(L, setmetatable_for_eval, 1);
-		lua_rawset(L, LUA_GLOBALSINDEX);
+	// The eval runs on a new thread, because the hooks of 'L'
+	// don't work while its hook is running (it's called in it),
+	// so the count hook of the budget is installed on the new thread.
+	lua_State *L1 = lua_newthread(L);
+	int threadIdx = lua_gettop(L);
+	lua_insert(L, threadIdx - 1);
+	--threadIdx;
 
-		lua_pushliteral(L, "__lldebug_getlocals__");
-		lua_pushnumber(L, (lua_Number)level);
-		lua_pushcclosure(L, getlocals_for_eval, 1);
-		lua_rawset(L, LUA_GLOBALSINDEX);
+	int mask = (withDebug ? lua_gethookmask(L1) & ~LUA_MASKCOUNT : 0);
+	int count = 0;
+	if (m_hasEvalBudget) {
+		mask |= LUA_MASKCOUNT;
+		count = LLDEBUG_EVALBUDGET_STEP;
 	}
+	lua_sethook(L1, (mask != 0 ? Context::s_HookCallback : NULL), mask, count);
+	ms_manager->Add(shared_from_this(), L1);
 
-	// on exit: globals[__lldebug_setmetatable__] = nil
-	struct call_on_exit {
-		lua_State *L;
-		call_on_exit(lua_State *L_) : L(L_) {}
-		~call_on_exit() {
-			lua_pushliteral(L, "__lldebug_setmetatable__");
-			lua_pushnil(L);
-			lua_rawset(L, LUA_GLOBALSINDEX);
-			lua_pushliteral(L, "__lldebug_getlocals__");
-			lua_pushnil(L);
-			lua_rawset(L, LUA_GLOBALSINDEX);
+	// The locals are read from 'L' through the thread argument.
+	int nargs = 0;
+	if (level >= 0) {
+		push_thread_for_eval(L, L);
+		lua_pushnumber(L, (lua_Number)level);
+		nargs = 2;
+
+		// The env shared by the batch evaluation.
+		if (envIdx != 0) {
+			lua_pushvalue(L, envIdx);
+			nargs = 3;
 		}
-	} exit_obj(L);
+	}
+	lua_xmove(L, L1, nargs + 1);
 
-	// Load string (use lua_load).
-	eval_string_reader reader(str, beginning, ending);
-	if (lua_load(L, eval_string_reader::exec, &reader, DUMMY_FUNCNAME) != 0) {
+	// Do execute !
+	// The eval may replace 'lldebug.tostring_for_varvalue'.
+	m_formatterUpdateCount = -1;
+	int ret = lua_pcall(L1, nargs, LUA_MULTRET, 0);
+	ms_manager->Erase(L1);
+
+	// Move the results or the error message to 'L'.
+	int n = lua_gettop(L1);
+	if (!lua_checkstack(L, n)) {
+		lua_settop(L1, 0);
+		lua_remove(L, threadIdx);
+		lua_pushliteral(L, "The eval returned too many results.");
 		scoped.check(1);
 		return -1;
 	}
+	lua_xmove(L1, L, n);
+	lua_remove(L, threadIdx);
 
-	// Do execute !
-	if (lua_pcall(L, 0, LUA_MULTRET, 0) != 0) {
+	if (ret != 0) {
 		scoped.check(1);
 		return -1;
 	}
@@ -1514,29 +2832,76 @@ int Context::LuaEval(lua_State *L, int level, const std::string &str, bool withD
 
 LuaVarList Context::LuaEvalsToVarList(const string_array &evals,
 									  const LuaStackFrame &stackFrame,
-									  bool withDebug) {
+									  bool withDebug,
+									  const LuaEvalBudget &budget) {
 	lua_State *L = stackFrame.GetLua().GetState();
 	if (L == NULL) L = GetLua();
 	scoped_lock lock(m_mutex);
 	scoped_lua scoped(this, L, withDebug);
+	int level = stackFrame.GetLevel();
 	LuaVarList result;
 
+	// The budget is shared by all evals of the batch,
+	// so the batch can't take more than one budget.
+	EvalBudgetScope budgetScope(this, L, budget);
+
+	// The env is made only once and all evals share it.
+	// Each eval is called in its own lua_pcall,
+	// so an error doesn't stop the rest.
+	int envIdx = 0;
+	if (level >= 0) {
+		push_env_for_eval(L, L, level);
+		envIdx = lua_gettop(L);
+	}
+
 	string_array::const_iterator it;
 	for (it = evals.begin(); it != evals.end(); ++it) {
-		result.push_back(LuaEvalToVar(*it, stackFrame, withDebug));
+		result.push_back(EvalToVar(L, *it, level, envIdx, withDebug, budget));
 	}
 
+	if (envIdx != 0) {
+		lua_pop(L, 1);
+	}
 	scoped.check(0);
 	return result;
 }
 
+/// Evaluate the registered watches at the current function.
+LuaWatchResults Context::EvalWatches(lua_State *L) {
+	scoped_lock lock(m_mutex);
+	LuaWatchResults results;
+
+	if (m_watches.empty()) {
+		return results;
+	}
+
+	string_array evals;
+	std::map<int, std::string>::iterator it;
+	for (it = m_watches.begin(); it != m_watches.end(); ++it) {
+		evals.push_back(it->second);
+	}
+
+	// Breakpoints in the watches mustn't stop the program here.
+	LuaVarList vars = LuaEvalsToVarList(
+		evals, LuaStackFrame(LuaHandle(L), 0), false);
+
+	LuaVarList::size_type i = 0;
+	for (it = m_watches.begin(); it != m_watches.end(); ++it, ++i) {
+		results[it->first] = vars[i];
+	}
+
+	return results;
+}
+
 LuaVarList Context::LuaEvalToMultiVar(const std::string &eval,
 									  const LuaStackFrame &stackFrame,
-									  bool withDebug) {
+									  bool withDebug,
+									  const LuaEvalBudget &budget) {
 	lua_State *L = stackFrame.GetLua().GetState();
 	if (L == NULL) L = GetLua();
 	scoped_lock lock(m_mutex);
 	scoped_lua scoped(this, L, withDebug);
+	EvalBudgetScope budgetScope(this, L, budget);
 	LuaVarList result;
 	int beginningtop = lua_gettop(L);
 
@@ -1551,7 +2916,8 @@ LuaVarList Context::LuaEvalToMultiVar(const std::string &eval,
 	// Convert the result to LuaVar objects.
 	int top = lua_gettop(L);
 	for (int idx = beginningtop + 1; idx <= top; ++idx) {
-		result.push_back(LuaVar(LuaHandle(L), eval, idx));
+		result.push_back(LuaVar(LuaHandle(L), eval, idx,
+								IsNativeFormatter(), m_previewLength));
 	}
 
 	lua_settop(L, beginningtop); // adjust the stack top
@@ -1561,14 +2927,26 @@ LuaVarList Context::LuaEvalToMultiVar(const std::string &eval,
 
 LuaVar Context::LuaEvalToVar(const std::string &eval,
 							 const LuaStackFrame &stackFrame,
-							 bool withDebug) {
+							 bool withDebug,
+							 const LuaEvalBudget &budget) {
 	lua_State *L = stackFrame.GetLua().GetState();
 	if (L == NULL) L = GetLua();
 	scoped_lock lock(m_mutex);
+
+	return EvalToVar(L, eval, stackFrame.GetLevel(), 0, withDebug, budget);
+}
+
+LuaVar Context::EvalToVar(lua_State *L, const std::string &eval, int level,
+						  int envIdx, bool withDebug,
+						  const LuaEvalBudget &budget) {
+	scoped_lock lock(m_mutex);
 	scoped_lua scoped(this, L, withDebug);
+	// The formatting of the result is done in lua_pcall on 'L',
+	// and an error in it falls back to the raw value.
+	EvalBudgetScope budgetScope(this, L, budget);
 	int beginningtop = lua_gettop(L);
 
-	if (LuaEval(L, stackFrame.GetLevel(), eval, withDebug) != 0) {
+	if (LuaEval(L, level, eval, withDebug, envIdx) != 0) {
 		std::string error = lua_tostring(L, -1);
 		lua_pop(L, 1);
 		scoped.check(0);
@@ -1582,7 +2960,8 @@ LuaVar Context::LuaEvalToVar(const std::string &eval,
 		return LuaVar();
 	}
 	else {
-		LuaVar result(LuaHandle(L), eval, beginningtop + 1);
+		LuaVar result(LuaHandle(L), eval, beginningtop + 1,
+					  IsNativeFormatter(), m_previewLength);
 		lua_settop(L, beginningtop); // adjust the stack top
 		scoped.check(0);
 		return result;
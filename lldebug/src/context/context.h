@@ -32,6 +32,10 @@
 #include "luainfo.h"
 #include "queue_mt.h"
 #include "net/command.h"
+#include "context/profiler.h"
+#include "context/coverage.h"
+#include "context/spanrecorder.h"
+#include "context/governor.h"
 
 namespace lldebug {
 namespace context {
@@ -76,6 +80,7 @@ public:
 				   const std::string &key=std::string(""), int line=-1);
 
 	void SetEncoding(lldebug_Encoding encoding);
+	void SetPreviewLength(int length);
 
 	//int DebugFile(const char *filename);
 
@@ -91,18 +96,29 @@ public:
 	int PCall(lua_State *L, int nargs, int nresults, int errfunc);
 	int Resume(lua_State *L, int nargs);
 
-	LuaVarList LuaGetGlobals();
-	LuaVarList LuaGetRegistories();
-	LuaVarList LuaGetFields(const LuaVar &var);
+	LuaVarList LuaGetGlobals(const LuaVarFilter &filter = LuaVarFilter());
+	LuaVarList LuaGetRegistories(const LuaVarFilter &filter = LuaVarFilter());
+	LuaVarList LuaGetFields(const LuaVarRef &ref, int updateCount,
+							const LuaVarFilter &filter = LuaVarFilter());
+	LuaVarListMap LuaPrefetchFields(const LuaVarList &vars,
+									const LuaVarFilter &filter,
+									int prefetchBytes, int prefetchDepth);
 	LuaVarList LuaGetLocals(const LuaStackFrame &stackFrame, bool checkLocal,
-							bool checkUpvalue, bool checkEnviron);
+							bool checkUpvalue, bool checkEnviron,
+							const LuaVarFilter &filter = LuaVarFilter());
 	LuaVarList LuaGetStack();
 	LuaBacktraceList LuaGetBacktrace();
-
-	int LuaEval(lua_State *L, int level, const std::string &str, bool withDebug);
-	LuaVarList LuaEvalsToVarList(const string_array &array, const LuaStackFrame &stackFrame, bool withDebug);
-	LuaVarList LuaEvalToMultiVar(const std::string &str, const LuaStackFrame &stackFrame, bool withDebug);
-	LuaVar LuaEvalToVar(const std::string &str, const LuaStackFrame &stackFrame, bool withDebug);
+	std::string LuaGetVarValue(const LuaVarRef &ref, int updateCount,
+							   int offset, int length);
+
+	int LuaEval(lua_State *L, int level, const std::string &str, bool withDebug,
+				int envIdx = 0);
+	LuaVarList LuaEvalsToVarList(const string_array &array, const LuaStackFrame &stackFrame, bool withDebug,
+								 const LuaEvalBudget &budget = LuaEvalBudget());
+	LuaVarList LuaEvalToMultiVar(const std::string &str, const LuaStackFrame &stackFrame, bool withDebug,
+								 const LuaEvalBudget &budget = LuaEvalBudget());
+	LuaVar LuaEvalToVar(const std::string &str, const LuaStackFrame &stackFrame, bool withDebug,
+						const LuaEvalBudget &budget = LuaEvalBudget());
 
 	/// Get the current lua_State object.
 	lua_State *GetLua() {
@@ -134,12 +150,24 @@ public:
 		return m_encoding;
 	}
 
+	/// Get the max length of the value string sent with LuaVar.
+	int GetPreviewLength() {
+		scoped_lock lock(m_mutex);
+		return m_previewLength;
+	}
+
 	/// Get the source object.
 	const Source *GetSource(const std::string &key) {
 		scoped_lock lock(m_mutex);
 		return m_sourceManager.Get(key);
 	}
 
+	/// Get the source object from the source id.
+	const Source *GetSource(int sourceId) {
+		scoped_lock lock(m_mutex);
+		return m_sourceManager.Get(sourceId);
+	}
+
 	/// Is debug enable ?
 	bool IsDebugEnabled() {
 		scoped_lock lock(m_mutex);
@@ -152,6 +180,70 @@ public:
 		m_isEnabled = enabled;
 	}
 
+	/// Start the profiler, the old profile is cleared.
+	/** The line hooks aren't used while profiling,
+	 * so the breakpoints don't work.
+	 */
+	void StartProfiler(lldebug_ProfileMode mode, int interval);
+
+	/// Stop the profiler.
+	void StopProfiler();
+
+	/// Make the string of the profile.
+	std::string DumpProfile(lldebug_ProfileFormat format);
+
+	/// Write the profile to the file.
+	int SaveProfile(const std::string &filename, lldebug_ProfileFormat format);
+
+	/// Start recording the line coverage, the old coverage is cleared.
+	/** The coverage is written to 'outputFile' when this is deleted,
+	 * if it isn't empty. The breakpoints don't work in the functions
+	 * whose lines were all executed.
+	 */
+	void StartCoverage(const std::string &outputFile);
+
+	/// Stop recording the line coverage.
+	void StopCoverage();
+
+	/// Make the string of the coverage with the lcov format.
+	std::string DumpCoverage();
+
+	/// Write the coverage to the file with the lcov format.
+	int SaveCoverage(const std::string &filename);
+
+	/// Start recording the trace spans, the old spans are cleared.
+	/** The calls of the functions are the spans too if 'autoSpans'.
+	 */
+	void StartSpans(bool autoSpans, int capacity);
+
+	/// Stop recording the trace spans.
+	void StopSpans();
+
+	/// Begin the trace span of 'L'.
+	void BeginSpan(lua_State *L, const std::string &name);
+
+	/// End the last trace span of 'L'.
+	int EndSpan(lua_State *L);
+
+	/// Make the string of the trace spans with the chrome trace format.
+	std::string DumpSpans();
+
+	/// Write the trace spans to the file with the chrome trace format.
+	int SaveSpans(const std::string &filename);
+
+	/// Start the governor that keeps the overhead of the hooks
+	/// under 'maxOverhead' (%).
+	/** The interval of the count hook is widened, and the line hook
+	 * of the coverage is dropped without the frame.
+	 */
+	void StartGovernor(double maxOverhead);
+
+	/// Stop the governor, the hooks are restored.
+	void StopGovernor();
+
+	/// Get the overhead (%) and the level of the governor.
+	void GetGovernorStatus(double &overhead, int &level);
+
 private:
 	int CreateDebuggerFrame();
 	int WaitForDebuggerFrame();
@@ -173,8 +265,27 @@ private:
 	};
 	LuaErrorData ParseLuaError(const std::string &str);
 	void OutputLogInternal(const LogData &logData, bool sendRemote);
-
-	static void SetHook(lua_State *L);
+	bool IsNativeFormatter();
+	void SetUpdateCount(int updateCount);
+	LuaVar EvalToVar(lua_State *L, const std::string &eval, int level,
+					 int envIdx, bool withDebug, const LuaEvalBudget &budget);
+	LuaWatchResults EvalWatches(lua_State *L);
+
+	class EvalBudgetScope;
+	friend class EvalBudgetScope;
+	class GovernorScope;
+	friend class GovernorScope;
+	void ApplyGovernor(lua_State *L);
+	static int s_CountHookCallback(lua_State *L, char *message, size_t size);
+	int CountHookCallback(lua_State *L, char *message, size_t size);
+	int CheckEvalBudget(char *message, size_t size);
+
+	int GetHookMask();
+	void SetHook(lua_State *L);
+	void ResyncCallCounts();
+	void SetCoverageHook(lua_State *L, bool needsLine);
+	void ResetLineHeats();
+	LuaLineHeatsMap GetLineHeats(const std::vector<int> &sourceIds);
 	void HookCallback(lua_State *L, lua_Debug *ar);
 	static void s_HookCallback(lua_State *L, lua_Debug *ar);
 	void SetDebugState(DebugState state);
@@ -182,6 +293,8 @@ private:
 	class LuaImpl;
 	friend class LuaImpl;
 	int LuaInitialize(lua_State *L);
+	void CreateCoroutine(lua_State *L, int idx);
+	void MarkCoroutine(lua_State *L, int idx);
 	void BeginCoroutine(lua_State *L);
 	void EndCoroutine(lua_State *L);
 
@@ -195,9 +308,26 @@ private:
 	DebugState m_debugState;
 	bool m_isCallSuccess;
 	bool m_isEnabled;
+	bool m_isDetached; ///< the frame wasn't found
 	int m_updateCount;
 	int m_waitUpdateCount;
 	bool m_isMustUpdate;
+	bool m_isWatchesNeeded; ///< the watches are needed by the refresh
+	int m_formatterUpdateCount;
+	bool m_isNativeFormatter;
+	int m_previewLength;
+	LuaEvalBudget m_evalBudget;
+	bool m_hasEvalBudget; ///< the budget is set by EvalBudgetScope
+	int m_evalDepth;
+	int m_evalInstructions;
+	boost::xtime m_evalEnd;
+	std::map<int, std::string> m_watches;
+	Profiler m_profiler;
+	Coverage m_coverage;
+	SpanRecorder m_spans;
+	Governor m_governor;
+	int m_heatGeneration; ///< changed when the heats are cleared
+	LuaLineHeatsMap m_sentHeats; ///< the heats sent to the frame
 	LoggerType m_logger;
 	lldebug_Encoding m_encoding;
 
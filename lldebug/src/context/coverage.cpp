@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "precomp.h"
+#include "sysinfo.h"
+#include "context/coverage.h"
+#include "context/luautils.h"
+
+#include <algorithm>
+
+namespace lldebug {
+namespace context {
+
+Coverage::Coverage()
+	: m_lastSource(NULL), m_lastSourceId(-1), m_isRunning(false) {
+}
+
+Coverage::~Coverage() {
+}
+
+void Coverage::Start(const std::string &outputFile) {
+	Clear();
+
+	m_outputFile = outputFile;
+	m_isRunning = true;
+}
+
+void Coverage::Stop() {
+	m_isRunning = false;
+}
+
+void Coverage::Clear() {
+	m_sourceIds.clear();
+	m_sourceNames.clear();
+	m_sources.clear();
+	m_lastSource = NULL;
+	m_lastSourceId = -1;
+	m_funcIds.clear();
+	m_funcs.clear();
+}
+
+/// Get the id of the source, the new source is registered.
+/** The source is found by the interned string pointer first.
+ * Only the head of the name is checked, because the pointer may be reused
+ * after the string was collected. The whole name is compared
+ * only when the pointer is new.
+ */
+int Coverage::GetSourceId(const char *source) {
+	if (source == m_lastSource
+		&& llutil_issamesource(m_sources[m_lastSourceId].key, source)) {
+		return m_lastSourceId;
+	}
+
+	int id;
+	SourceIdMap::iterator it = m_sourceIds.find(source);
+	if (it != m_sourceIds.end()
+		&& llutil_issamesource(m_sources[it->second].key, source)) {
+		id = it->second;
+	}
+	else {
+		std::map<std::string, int>::iterator nameIt = m_sourceNames.find(source);
+		if (nameIt != m_sourceNames.end()) {
+			id = nameIt->second;
+		}
+		else {
+			id = (int)m_sources.size();
+			m_sources.push_back(SourceInfo());
+			m_sources.back().key = source;
+			m_sourceNames.insert(std::make_pair(std::string(source), id));
+		}
+		m_sourceIds[source] = id;
+	}
+
+	m_lastSource = source;
+	m_lastSourceId = id;
+	return id;
+}
+
+/// Make the key of the function of 'ar'.
+/** The functions defined in the same line can't be told apart,
+ * and lua 5.0 has no 'lastlinedefined'.
+ */
+Coverage::FuncKey Coverage::MakeFuncKey(int sourceId, const lua_Debug *ar) {
+#ifdef LUA_VERSION_NUM
+	int lastline = ar->lastlinedefined;
+#else
+	int lastline = -1;
+#endif
+
+	return FuncKey(sourceId, std::make_pair(ar->linedefined, lastline));
+}
+
+/// Get the id of the function of 'ar', the new function is registered.
+/** 'ar' must have the "S" infomation.
+ */
+int Coverage::GetFuncId(lua_State *L, lua_Debug *ar) {
+	int sourceId = GetSourceId(ar->source);
+	FuncKey key = MakeFuncKey(sourceId, ar);
+	FuncIdMap::iterator it = m_funcIds.find(key);
+	if (it != m_funcIds.end()) {
+		return it->second;
+	}
+
+	FuncInfo info;
+	info.source = sourceId;
+	info.remaining = -1;
+
+#ifdef LUA_VERSION_NUM
+	// The active lines are got only once for each function.
+	SourceInfo &source = m_sources[sourceId];
+	info.remaining = 0;
+	lua_getinfo(L, "L", ar);
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		size_t line = (size_t)lua_tonumber(L, -2);
+		lua_pop(L, 1);
+
+		if (line >= source.active.size()) {
+			source.active.resize(line + 1, false);
+		}
+		if (line >= source.lines.size()) {
+			source.lines.resize(line + 1, false);
+		}
+
+		source.active[line] = true;
+		if (!source.lines[line]) {
+			++info.remaining;
+		}
+	}
+	lua_pop(L, 1);
+
+	// The functions in one line share the key,
+	// so the line hook is always kept for them.
+	// The main chunk has 0 for both lines, but it's unique in the source.
+	if (ar->linedefined == ar->lastlinedefined && *ar->what != 'm') {
+		info.remaining = -1;
+	}
+#endif
+
+	int id = (int)m_funcs.size();
+	m_funcs.push_back(info);
+	m_funcIds.insert(std::make_pair(key, id));
+	return id;
+}
+
+bool Coverage::OnCall(lua_State *L, lua_Debug *ar) {
+	lua_getinfo(L, "S", ar);
+
+	// The C function has no lines.
+	if (*ar->what == 'C') {
+		return false;
+	}
+
+	return (m_funcs[GetFuncId(L, ar)].remaining != 0);
+}
+
+bool Coverage::OnReturn(lua_State *L) {
+	lua_Debug ar;
+
+	// The level 0 is the returning function.
+	if (lua_getstack(L, 1, &ar) == 0) {
+		return true;
+	}
+
+	lua_getinfo(L, "S", &ar);
+	if (*ar.what == 'C') {
+		return false;
+	}
+	else if (*ar.what == 't') {
+		return true; // the caller was lost by the tail call
+	}
+
+	return (m_funcs[GetFuncId(L, &ar)].remaining != 0);
+}
+
+const std::vector<bool> *Coverage::GetExecutedLines(
+	const std::string &key) const {
+	std::map<std::string, int>::const_iterator it = m_sourceNames.find(key);
+	return (it != m_sourceNames.end() ? &m_sources[it->second].lines : NULL);
+}
+
+void Coverage::OnLine(lua_State *L, lua_Debug *ar) {
+	lua_getinfo(L, "S", ar);
+	if (*ar->what == 'C' || ar->currentline <= 0) {
+		return;
+	}
+
+	int sourceId = GetSourceId(ar->source);
+	SourceInfo &source = m_sources[sourceId];
+	size_t line = (size_t)ar->currentline;
+	if (line >= source.lines.size()) {
+		source.lines.resize(line + 1, false);
+	}
+	if (source.lines[line]) {
+		return;
+	}
+	source.lines[line] = true;
+
+	// The function is searched only at the first execution of the line.
+	if (line < source.active.size() && source.active[line]) {
+		FuncIdMap::iterator it = m_funcIds.find(MakeFuncKey(sourceId, ar));
+		if (it != m_funcIds.end() && m_funcs[it->second].remaining > 0) {
+			--m_funcs[it->second].remaining;
+		}
+	}
+}
+
+std::string Coverage::DumpLcov(SourceManager &sourceManager) const {
+	std::string result;
+
+	for (size_t i = 0; i < m_sources.size(); ++i) {
+		const SourceInfo &source = m_sources[i];
+
+		// It's a file if the beginning char is '@'.
+		if (source.key.empty() || source.key[0] != '@') {
+			continue;
+		}
+
+		const Source *src = sourceManager.Get(source.key);
+		if (src == NULL) {
+			sourceManager.Add(source.key, source.key.substr(1));
+			src = sourceManager.Get(source.key);
+		}
+
+		result += "TN:\n";
+		result += "SF:";
+		result += ((src != NULL && !src->GetPath().empty())
+			? src->GetPath()
+			: source.key.substr(1));
+		result += "\n";
+
+		int found = 0, hit = 0;
+		size_t size = std::max(source.lines.size(), source.active.size());
+		for (size_t line = 1; line < size; ++line) {
+			bool isActive = (line < source.active.size() && source.active[line]);
+			bool isHit = (line < source.lines.size() && source.lines[line]);
+			if (!isActive && !isHit) {
+				continue;
+			}
+
+			result += "DA:";
+			result += boost::lexical_cast<std::string>(line);
+			result += (isHit ? ",1\n" : ",0\n");
+			++found;
+			hit += (isHit ? 1 : 0);
+		}
+
+		result += "LF:" + boost::lexical_cast<std::string>(found) + "\n";
+		result += "LH:" + boost::lexical_cast<std::string>(hit) + "\n";
+		result += "end_of_record\n";
+	}
+
+	return result;
+}
+
+} // end of namespace context
+} // end of namespace lldebug
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __LLDEBUG_COVERAGE_H__
+#define __LLDEBUG_COVERAGE_H__
+
+namespace lldebug {
+
+class SourceManager;
+
+namespace context {
+
+/**
+ * @brief Line coverage of the lua sources.
+ *
+ * The executed lines are recorded by the line hook into the bitmap
+ * of each source. The active lines of each function are got at its first
+ * call, so the line hook isn't needed for the function whose lines were
+ * all executed. It's used under the lock of the Context.
+ */
+class Coverage {
+public:
+	explicit Coverage();
+	~Coverage();
+
+	/// Is the coverage recording ?
+	bool IsRunning() const {
+		return m_isRunning;
+	}
+
+	/// Get the file that the coverage is written when closed.
+	const std::string &GetOutputFile() const {
+		return m_outputFile;
+	}
+
+	/// Clear the old coverage and start recording.
+	/** 'outputFile' may be empty.
+	 */
+	void Start(const std::string &outputFile);
+
+	/// Stop recording, the coverage is kept until the next start.
+	void Stop();
+
+	/// Clear the coverage.
+	void Clear();
+
+	/// The function of 'ar' was called.
+	/** It returns false if the line hook isn't needed for the function.
+	 */
+	bool OnCall(lua_State *L, lua_Debug *ar);
+
+	/// The function returned to the caller.
+	/** It returns false if the line hook isn't needed for the caller.
+	 */
+	bool OnReturn(lua_State *L);
+
+	/// The line of 'ar' is executed.
+	void OnLine(lua_State *L, lua_Debug *ar);
+
+	/// Get the executed lines of the source.
+	/** The index is the line number, NULL if the source wasn't executed.
+	 */
+	const std::vector<bool> *GetExecutedLines(const std::string &key) const;
+
+	/// Make the string of the coverage with the lcov format.
+	/** The file paths are resolved by 'sourceManager',
+	 * and the string sources aren't written.
+	 */
+	std::string DumpLcov(SourceManager &sourceManager) const;
+
+private:
+	/// Executed lines of the source.
+	struct SourceInfo {
+		std::string key;
+		std::vector<bool> lines; ///< executed lines
+		std::vector<bool> active; ///< lines of the called functions
+	};
+
+	/// Coverage of the function.
+	struct FuncInfo {
+		int source;
+		int remaining; ///< active lines not executed yet, -1 if unknown
+	};
+
+	typedef std::pair<int, std::pair<int, int> > FuncKey;
+	static FuncKey MakeFuncKey(int sourceId, const lua_Debug *ar);
+
+	int GetSourceId(const char *source);
+	int GetFuncId(lua_State *L, lua_Debug *ar);
+
+private:
+	typedef std::map<const char *, int> SourceIdMap;
+	SourceIdMap m_sourceIds; ///< the interned source pointer -> source
+	std::map<std::string, int> m_sourceNames;
+	std::vector<SourceInfo> m_sources;
+	const char *m_lastSource;
+	int m_lastSourceId;
+
+	typedef std::map<FuncKey, int> FuncIdMap;
+	FuncIdMap m_funcIds; ///< (source, (linedefined, lastlinedefined)) -> func
+	std::vector<FuncInfo> m_funcs;
+
+	bool m_isRunning;
+	std::string m_outputFile;
+};
+
+} // end of namespace context
+} // end of namespace lldebug
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "precomp.h"
+#include "context/governor.h"
+
+/// The length of the window in microseconds.
+#ifndef LLDEBUG_GOVERNOR_WINDOW
+#define LLDEBUG_GOVERNOR_WINDOW 500000
+#endif
+
+/// The max level of the governor.
+#ifndef LLDEBUG_GOVERNOR_MAXLEVEL
+#define LLDEBUG_GOVERNOR_MAXLEVEL 16
+#endif
+
+namespace lldebug {
+namespace context {
+
+Governor::Governor()
+	: m_isRunning(false), m_isInterrupted(false)
+	, m_maxOverhead(LLDEBUG_DEFAULT_MAXOVERHEAD), m_overhead(0.0)
+	, m_level(0), m_windowStart(0), m_hookTime(0) {
+}
+
+Governor::~Governor() {
+}
+
+void Governor::Start(double maxOverhead) {
+	m_maxOverhead = (maxOverhead > 0.0 ? maxOverhead : LLDEBUG_DEFAULT_MAXOVERHEAD);
+	m_overhead = 0.0;
+	m_level = 0;
+	m_isInterrupted = false;
+	ResetWindow(Profiler::GetMonotonicTime());
+	m_isRunning = true;
+}
+
+void Governor::Stop() {
+	m_level = 0;
+	m_isRunning = false;
+}
+
+void Governor::ResetWindow(Cost now) {
+	m_windowStart = now;
+	m_hookTime = 0;
+}
+
+Governor::Cost Governor::Enter() {
+	return Profiler::GetMonotonicTime();
+}
+
+bool Governor::Leave(Cost enterTime) {
+	Cost now = Profiler::GetMonotonicTime();
+
+	// The time waiting for the frame isn't the overhead.
+	if (m_isInterrupted) {
+		m_isInterrupted = false;
+		ResetWindow(now);
+		return false;
+	}
+
+	m_hookTime += now - enterTime;
+	Cost elapsed = now - m_windowStart;
+	if (elapsed < LLDEBUG_GOVERNOR_WINDOW) {
+		return false;
+	}
+
+	// The level is lowered slowly to avoid the oscillation.
+	int oldLevel = m_level;
+	m_overhead = 100.0 * m_hookTime / elapsed;
+	if (m_overhead > m_maxOverhead) {
+		if (m_level < LLDEBUG_GOVERNOR_MAXLEVEL) {
+			++m_level;
+		}
+	}
+	else if (m_overhead < m_maxOverhead / 4 && m_level > 0) {
+		--m_level;
+	}
+
+	ResetWindow(now);
+	return (m_level != oldLevel);
+}
+
+} // end of namespace context
+} // end of namespace lldebug
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __LLDEBUG_GOVERNOR_H__
+#define __LLDEBUG_GOVERNOR_H__
+
+#include "context/profiler.h"
+
+namespace lldebug {
+namespace context {
+
+/**
+ * @brief Governor of the overhead of the hooks.
+ *
+ * The time in the hooks is measured for each window, and the level
+ * is raised if its ratio to the elapsed time is over the limit,
+ * or lowered if it's under the quarter of the limit.
+ * The Context widens the interval of the count hook by the level,
+ * and drops the line hook without the frame.
+ * It's used under the lock of the Context.
+ */
+class Governor {
+public:
+	typedef Profiler::Cost Cost;
+
+	explicit Governor();
+	~Governor();
+
+	/// Is the governor running ?
+	bool IsRunning() const {
+		return m_isRunning;
+	}
+
+	/// Get the level, the interval of the count hook is 2^level times.
+	int GetLevel() const {
+		return m_level;
+	}
+
+	/// Get the overhead (%) measured in the last window.
+	double GetOverhead() const {
+		return m_overhead;
+	}
+
+	/// Get the limit of the overhead (%).
+	double GetMaxOverhead() const {
+		return m_maxOverhead;
+	}
+
+	/// Start the governor with the limit of the overhead (%).
+	void Start(double maxOverhead);
+
+	/// Stop the governor, the level is reset.
+	void Stop();
+
+	/// The hook was entered, it returns the current time.
+	Cost Enter();
+
+	/// The hook that was entered at 'enterTime' is left.
+	/** It returns true if the level was changed.
+	 */
+	bool Leave(Cost enterTime);
+
+	/// The hook is waiting for the frame,
+	/// so the current window isn't measured.
+	void Interrupt() {
+		m_isInterrupted = true;
+	}
+
+private:
+	void ResetWindow(Cost now);
+
+private:
+	bool m_isRunning;
+	bool m_isInterrupted;
+	double m_maxOverhead;
+	double m_overhead;
+	int m_level;
+	Cost m_windowStart;
+	Cost m_hookTime; ///< the time in the hooks of the current window
+};
+
+} // end of namespace context
+} // end of namespace lldebug
+
+#endif
@@ -27,6 +27,7 @@
 #include "precomp.h"
 #include "lldebug.h"
 #include "context/context.h"
+#include "context/luautils.h"
 
 using namespace lldebug;
 using context::Context;
@@ -42,9 +43,18 @@ struct LogWrapper {
 			return;
 		}
 
+		// The remote log has only the source id.
+		std::string key = logData.GetKey();
+		if (key.empty()) {
+			const Source *source = ctx->GetSource(logData.GetSourceId());
+			if (source != NULL) {
+				key = source->GetKey();
+			}
+		}
+
 		m_logger(
 			ctx->GetLua(), m_data, logData.GetLog().c_str(),
-			logData.GetKey().c_str(), logData.GetLine(),
+			key.c_str(), logData.GetLine(),
 			(logData.IsRemote() ? 1 : 0));
 	}
 	};
@@ -206,6 +216,166 @@ lldebug_Encoding lldebug_getencoding(lua_State *L) {
 	return ctx->GetEncoding();
 }
 
+int lldebug_setpreviewlength(lua_State *L, int length) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->SetPreviewLength(length);
+	return 0;
+}
+
+int lldebug_getpreviewlength(lua_State *L) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	return ctx->GetPreviewLength();
+}
+
+int lldebug_registerformatter(lua_State *L, int idx,
+							  lldebug_Formatter formatter) {
+	return context::llutil_registerformatter(L, idx, formatter);
+}
+
+int lldebug_registertypeformatter(lua_State *L, const char *tname,
+								  lldebug_Formatter formatter) {
+	luaL_getmetatable(L, tname);
+	int result = context::llutil_registerformatter(L, -1, formatter);
+	lua_pop(L, 1);
+	return result;
+}
+
+int lldebug_startprofiler(lua_State *L, lldebug_ProfileMode mode,
+						  int interval) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StartProfiler(mode, interval);
+	return 0;
+}
+
+int lldebug_stopprofiler(lua_State *L) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StopProfiler();
+	return 0;
+}
+
+int lldebug_dumpprofile(lua_State *L, const char *filename,
+						lldebug_ProfileFormat format) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL || filename == NULL) {
+		return -1;
+	}
+
+	return ctx->SaveProfile(filename, format);
+}
+
+int lldebug_startcoverage(lua_State *L, const char *filename) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StartCoverage(filename != NULL ? filename : "");
+	return 0;
+}
+
+int lldebug_stopcoverage(lua_State *L) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StopCoverage();
+	return 0;
+}
+
+int lldebug_dumpcoverage(lua_State *L, const char *filename) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL || filename == NULL) {
+		return -1;
+	}
+
+	return ctx->SaveCoverage(filename);
+}
+
+int lldebug_startspans(lua_State *L, int autoSpans, int capacity) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StartSpans(autoSpans != 0, capacity);
+	return 0;
+}
+
+int lldebug_stopspans(lua_State *L) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StopSpans();
+	return 0;
+}
+
+int lldebug_spanbegin(lua_State *L, const char *name) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL || name == NULL) {
+		return -1;
+	}
+
+	ctx->BeginSpan(L, name);
+	return 0;
+}
+
+int lldebug_spanend(lua_State *L) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	return ctx->EndSpan(L);
+}
+
+int lldebug_dumpspans(lua_State *L, const char *filename) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL || filename == NULL) {
+		return -1;
+	}
+
+	return ctx->SaveSpans(filename);
+}
+
+int lldebug_startgovernor(lua_State *L, double maxOverhead) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StartGovernor(maxOverhead);
+	return 0;
+}
+
+int lldebug_stopgovernor(lua_State *L) {
+	shared_ptr<Context> ctx = Context::Find(L);
+	if (ctx == NULL) {
+		return -1;
+	}
+
+	ctx->StopGovernor();
+	return 0;
+}
+
 
 static std::string s_hostname = "localhost";
 static unsigned short s_port = 24752;
@@ -208,5 +208,184 @@ int set_localvalue(lua_State *L, int level, const std::string &target,
 	return -1;
 }
 
+int make_localindex(lua_State *L, int level) {
+	scoped_lua scoped(L);
+	const char *cname;
+	lua_Debug ar;
+
+	lua_newtable(L);
+	int table = lua_gettop(L);
+
+	if (lua_getstack(L, level, &ar) == 0) {
+		// The stack level don't exist.
+		return scoped.check(1);
+	}
+
+	// The first one wins as 'find_localvalue' does,
+	// so the name that is already indexed isn't overwritten.
+	for (int i = 1; (cname = lua_getlocal(L, &ar, i)) != NULL; ++i) {
+		lua_pop(L, 1); // Eliminate the local value.
+		if (strcmp(cname, "(*temporary)") == 0) {
+			continue;
+		}
+
+		lua_pushstring(L, cname);
+		lua_rawget(L, table);
+		if (lua_isnil(L, -1)) {
+			lua_pushstring(L, cname);
+			lua_pushnumber(L, (lua_Number)i);
+			lua_rawset(L, table);
+		}
+		lua_pop(L, 1);
+	}
+
+	if (lua_getinfo(L, "f", &ar) != 0) {
+		for (int i = 1; (cname = lua_getupvalue(L, -1, i)) != NULL; ++i) {
+			lua_pop(L, 1); // Eliminate the upvalue.
+
+			lua_pushstring(L, cname);
+			lua_rawget(L, table);
+			if (lua_isnil(L, -1)) {
+				lua_pushstring(L, cname);
+				lua_pushnumber(L, (lua_Number)-i);
+				lua_rawset(L, table);
+			}
+			lua_pop(L, 1);
+		}
+
+		lua_pop(L, 1); // Eliminate the local function.
+	}
+
+	return scoped.check(1);
+}
+
+/// Get the index of 'target' from the local index table, or 0.
+static int get_localindex(lua_State *L, int indexIdx,
+						  const std::string &target) {
+	lua_pushlstring(L, target.c_str(), target.length());
+	lua_rawget(L, indexIdx);
+	int n = (int)lua_tonumber(L, -1);
+	lua_pop(L, 1);
+	return n;
+}
+
+int find_indexedvalue(lua_State *L, int level, int indexIdx,
+					  const std::string &target, bool checkEnv) {
+	scoped_lua scoped(L);
+	lua_Debug ar;
+
+	if (lua_getstack(L, level, &ar) == 0) {
+		// The stack level don't exist.
+		return -1;
+	}
+
+	int n = get_localindex(L, indexIdx, target);
+	if (n > 0) {
+		if (lua_getlocal(L, &ar, n) == NULL) {
+			scoped.check(0);
+			return -1;
+		}
+		scoped.check(1);
+		return 0;
+	}
+
+	if (lua_getinfo(L, "f", &ar) == 0) {
+		scoped.check(0);
+		return -1;
+	}
+
+	if (n < 0) {
+		if (lua_getupvalue(L, -1, -n) == NULL) {
+			lua_pop(L, 1);
+			scoped.check(0);
+			return -1;
+		}
+		lua_remove(L, -2); // Eliminate the local function.
+		scoped.check(1);
+		return 0;
+	}
+
+	if (checkEnv) {
+		// Look up the environment table directly.
+		lua_getfenv(L, -1);
+		lua_pushlstring(L, target.c_str(), target.length());
+		lua_rawget(L, -2);
+		if (!lua_isnil(L, -1)) {
+			lua_replace(L, -3);
+			lua_pop(L, 1);
+			scoped.check(1);
+			return 0;
+		}
+		lua_pop(L, 2); // Eliminate the nil and the environment table.
+	}
+
+	lua_pop(L, 1); // Eliminate the local function.
+	scoped.check(0);
+	return -1;
+}
+
+int set_indexedvalue(lua_State *L, int level, int indexIdx,
+					 const std::string &target, int valueIdx, bool checkEnv) {
+	scoped_lua scoped(L);
+	lua_Debug ar;
+
+	if (valueIdx < 0 && valueIdx > LUA_REGISTRYINDEX) {
+		valueIdx = lua_gettop(L) + valueIdx + 1;
+	}
+
+	if (lua_getstack(L, level, &ar) == 0) {
+		// The stack level don't exist.
+		return -1;
+	}
+
+	int n = get_localindex(L, indexIdx, target);
+	if (n > 0) {
+		lua_pushvalue(L, valueIdx); // new value
+		if (lua_setlocal(L, &ar, n) == NULL) {
+			lua_pop(L, 1);
+			scoped.check(0);
+			return -1;
+		}
+		scoped.check(0);
+		return 0;
+	}
+
+	if (lua_getinfo(L, "f", &ar) == 0) {
+		scoped.check(0);
+		return -1;
+	}
+
+	if (n < 0) {
+		lua_pushvalue(L, valueIdx); // new value
+		if (lua_setupvalue(L, -2, -n) == NULL) {
+			lua_pop(L, 1);
+		}
+		lua_pop(L, 1); // Eliminate the local function.
+		scoped.check(0);
+		return 0;
+	}
+
+	if (checkEnv) {
+		// Only the existing field can be set.
+		lua_getfenv(L, -1);
+		lua_pushlstring(L, target.c_str(), target.length());
+		lua_rawget(L, -2);
+		if (!lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			lua_pushlstring(L, target.c_str(), target.length());
+			lua_pushvalue(L, valueIdx);
+			lua_settable(L, -3);
+			lua_pop(L, 2);
+			scoped.check(0);
+			return 0;
+		}
+		lua_pop(L, 2); // Eliminate the nil and the environment table.
+	}
+
+	lua_pop(L, 1); // Eliminate the local function.
+	scoped.check(0);
+	return -1;
+}
+
 } // end of namespace context
 } // end of namespace lldebug
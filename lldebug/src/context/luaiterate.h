@@ -31,6 +31,11 @@
 #include "luainfo.h"
 #include "context/luautils.h"
 
+/// The estimated bytes of one var besides its strings.
+#ifndef LLDEBUG_VARLIST_VAROVERHEAD
+#define LLDEBUG_VARLIST_VAROVERHEAD 32
+#endif
+
 namespace lldebug {
 namespace context {
 
@@ -50,22 +55,178 @@ int set_localvalue(lua_State *L, int level, const std::string &target,
 				   int valueIdx, bool checkLocal, bool checkUpvalue,
 				   bool checkEnv, bool forceCreate);
 
+/// Push the name index of the locals and upvalues at the level.
+/** It's the table of name -> local index (plus) or upvalue index (minus).
+ */
+int make_localindex(lua_State *L, int level);
+
+/// Find the local value using the name index, and push it if find.
+/** The environment table isn't iterated, the target is looked up directly.
+ */
+int find_indexedvalue(lua_State *L, int level, int indexIdx,
+					  const std::string &target, bool checkEnv);
+
+/// Set the new value to the local variable using the name index.
+int set_indexedvalue(lua_State *L, int level, int indexIdx,
+					 const std::string &target, int valueIdx, bool checkEnv);
+
 /**
  * @brief Make a LuaVarList object.
  */
 struct varlist_maker {
+	explicit varlist_maker(bool isNativeFormatter = false,
+						   int previewLength = -1,
+						   const LuaVarFilter &filter = LuaVarFilter(),
+						   int maxBytes = -1)
+		: m_isNativeFormatter(isNativeFormatter)
+		, m_previewLength(previewLength), m_filter(filter)
+		, m_maxBytes(maxBytes), m_bytes(0)
+		, m_L(NULL), m_pending(LUA_NOREF) {
+	}
+
+	~varlist_maker() {
+		if (m_pending != LUA_NOREF) {
+			luaL_unref(m_L, LUA_REGISTRYINDEX, m_pending);
+		}
+	}
+
 	int operator()(lua_State *L, const std::string &name, int valueIdx) {
-		m_result.push_back(LuaVar(LuaHandle(L), name, valueIdx));
+		// The filter is checked before the value is formatted.
+		int type = lua_type(L, valueIdx);
+		if (!m_filter.MatchType(type)) {
+			return 0;
+		}
+
+		if (type == LUA_TFUNCTION) {
+			if (m_filter.IsHideFunctions()) {
+				return 0;
+			}
+			if (m_filter.IsHideCFunctions() && lua_iscfunction(L, valueIdx)) {
+				return 0;
+			}
+		}
+
+		// If the vars aren't sorted, the rest is never shown.
+		if (m_filter.GetSortOrder() == LuaVarFilter::SORTORDER_NONE
+			&& m_filter.GetMaxCount() >= 0
+			&& (int)m_result.size() >= m_filter.GetMaxCount()) {
+			return 0;
+		}
+
+		if (!m_filter.MatchName(name)) {
+			return 0;
+		}
+
+		// The vars sorted by name are cut before they are formatted,
+		// so only the values are kept until the names are sorted.
+		if (is_deferred()) {
+			defer(L, name, valueIdx);
+			return 0;
+		}
+
+		m_result.push_back(
+			LuaVar(LuaHandle(L), name, valueIdx,
+				   m_isNativeFormatter, m_previewLength));
+
+		// The iteration is stopped as soon as the size exceeds the max.
+		const LuaVar &var = m_result.back();
+		m_bytes += (int)(var.GetName().size() + var.GetValue().size());
+		m_bytes += LLDEBUG_VARLIST_VAROVERHEAD;
+		if (m_maxBytes >= 0 && m_bytes > m_maxBytes) {
+			return -1;
+		}
 		return 0;
 	}
 
-	/// Get the result.
+	/// Get the estimated size of the vars, which aren't cut by the filter.
+	int get_bytes() const {
+		return m_bytes;
+	}
+
+	/// Get the result, which is sorted and cut by the filter.
 	LuaVarList &get_result() {
+		if (m_pending != LUA_NOREF) {
+			make_deferred();
+		}
+
+		m_filter.Arrange(m_result);
 		return m_result;
 	}
 
+private:
+	/// Are the vars made after the names are sorted and cut ?
+	bool is_deferred() const {
+		return (m_filter.GetSortOrder() == LuaVarFilter::SORTORDER_NAME
+			&& m_filter.GetMaxCount() >= 0);
+	}
+
+	/// Keep the value(valueIdx) in the pending table.
+	void defer(lua_State *L, const std::string &name, int valueIdx) {
+		scoped_lua scoped(L);
+
+		if (valueIdx < 0 && valueIdx > LUA_REGISTRYINDEX) {
+			valueIdx = lua_gettop(L) + valueIdx + 1;
+		}
+
+		if (m_pending == LUA_NOREF) {
+			lua_newtable(L);
+			m_pending = luaL_ref(L, LUA_REGISTRYINDEX);
+			m_L = L;
+		}
+
+		// pending[n] = value
+		int n = (int)m_names.size() + 1;
+		lua_rawgeti(L, LUA_REGISTRYINDEX, m_pending);
+		lua_pushvalue(L, valueIdx);
+		lua_rawseti(L, -2, n);
+		lua_pop(L, 1);
+		m_names.push_back(std::make_pair(name, n));
+		scoped.check(0);
+	}
+
+	/// Make the vars of the pending values whose names are kept.
+	void make_deferred() {
+		lua_State *L = m_L;
+		scoped_lua scoped(L);
+
+		// The pairs are sorted by the name and then by the order.
+		std::sort(m_names.begin(), m_names.end());
+		if (m_names.size() > (size_t)m_filter.GetMaxCount()) {
+			m_names.resize(m_filter.GetMaxCount());
+		}
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, m_pending);
+		int pending = lua_gettop(L);
+		for (size_t i = 0; i < m_names.size(); ++i) {
+			lua_rawgeti(L, pending, m_names[i].second);
+			m_result.push_back(
+				LuaVar(LuaHandle(L), m_names[i].first, lua_gettop(L),
+					   m_isNativeFormatter, m_previewLength));
+			lua_pop(L, 1);
+
+			const LuaVar &var = m_result.back();
+			m_bytes += (int)(var.GetName().size() + var.GetValue().size());
+			m_bytes += LLDEBUG_VARLIST_VAROVERHEAD;
+		}
+		lua_pop(L, 1);
+
+		luaL_unref(L, LUA_REGISTRYINDEX, m_pending);
+		m_pending = LUA_NOREF;
+		m_names.clear();
+		scoped.check(0);
+	}
+
 private:
 	LuaVarList m_result;
+	bool m_isNativeFormatter;
+	int m_previewLength;
+	LuaVarFilter m_filter;
+	int m_maxBytes;
+	int m_bytes;
+
+	lua_State *m_L;
+	int m_pending; ///< the reference of the pending values
+	std::vector<std::pair<std::string, int> > m_names; ///< name, index of the pending
 };
 
 
@@ -115,17 +276,17 @@ int iterate_fields(Fn &callback, lua_State *L, int idx) {
 	return 0;
 }
 
-/// Iterate the all fields of var.
+/// Iterate the all fields of the referenced var.
 template<class Fn>
-int iterate_var(Fn &callback, const LuaVar &var) {
-	lua_State *L = var.GetLua().GetState();
+int iterate_var(Fn &callback, const LuaVarRef &ref) {
+	lua_State *L = ref.GetLua().GetState();
 	scoped_lua scoped(L);
 
-	if (!var.IsOk()) {
+	if (!ref.IsOk()) {
 		return -1;
 	}
 
-	if (var.PushTable(L) != 0) {
+	if (ref.PushTable(L) != 0) {
 		scoped.check(0);
 		return -1;
 	}
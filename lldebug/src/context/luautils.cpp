@@ -29,6 +29,11 @@
 #include "context/luautils.h"
 #include "context/luaiterate.h"
 
+/// The length of the head of the source names that is compared.
+#ifndef LLDEBUG_SOURCE_CHECKLENGTH
+#define LLDEBUG_SOURCE_CHECKLENGTH 64
+#endif
+
 namespace lldebug {
 namespace context {
 
@@ -49,6 +54,10 @@ int llutil_rawget(lua_State *L, const char *name) {
 	return 1;
 }
 
+bool llutil_issamesource(const std::string &key, const char *source) {
+	return (strncmp(key.c_str(), source, LLDEBUG_SOURCE_CHECKLENGTH) == 0);
+}
+
 std::string llutil_makefuncname(lua_Debug *ar) {
 	std::string name;
 
@@ -73,6 +82,86 @@ std::string llutil_makefuncname(lua_Debug *ar) {
 	return name;
 }
 
+/// Find the string key of the C function 'f' in the table(idx).
+static bool findcfunckey(lua_State *L, int idx, lua_CFunction f,
+						 std::string &name) {
+	lua_pushnil(L);
+	while (lua_next(L, idx) != 0) {
+		if (lua_type(L, -2) == LUA_TSTRING && lua_tocfunction(L, -1) == f) {
+			name = lua_tostring(L, -2);
+			lua_pop(L, 2);
+			return true;
+		}
+		lua_pop(L, 1);
+	}
+
+	return false;
+}
+
+/// Find the C function 'f' in the tables of the table(idx).
+/** The name is "table<sep>field", and the '__index' table
+ * of the metatable is searched too.
+ */
+static bool findcfuncsubkey(lua_State *L, int idx, lua_CFunction f,
+							const char *sep, std::string &name) {
+	lua_pushnil(L);
+	while (lua_next(L, idx) != 0) {
+		if (lua_type(L, -2) == LUA_TSTRING && lua_istable(L, -1)) {
+			int table = lua_gettop(L);
+			std::string field;
+			bool found = findcfunckey(L, table, f, field);
+
+			if (!found) {
+				lua_pushliteral(L, "__index");
+				lua_rawget(L, table);
+				if (lua_istable(L, -1)) {
+					found = findcfunckey(L, lua_gettop(L), f, field);
+				}
+				lua_pop(L, 1);
+			}
+
+			if (found) {
+				name = std::string(lua_tostring(L, -2)) + sep + field;
+				lua_pop(L, 2);
+				return true;
+			}
+		}
+		lua_pop(L, 1);
+	}
+
+	return false;
+}
+
+std::string llutil_findcfuncname(lua_State *L, lua_CFunction f) {
+	scoped_lua scoped(L);
+	std::string name;
+
+	if (f == NULL || !lua_checkstack(L, 8)) {
+		return name;
+	}
+
+	if (findcfunckey(L, LUA_GLOBALSINDEX, f, name)
+		|| findcfuncsubkey(L, LUA_GLOBALSINDEX, f, ".", name)) {
+		scoped.check(0);
+		return name;
+	}
+
+	// The modules that aren't global.
+	lua_pushliteral(L, "_LOADED");
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	bool found = (lua_istable(L, -1)
+		&& findcfuncsubkey(L, lua_gettop(L), f, ".", name));
+	lua_pop(L, 1);
+
+	// The metatables registered by luaL_newmetatable.
+	if (!found) {
+		findcfuncsubkey(L, LUA_REGISTRYINDEX, f, ":", name);
+	}
+
+	scoped.check(0);
+	return name;
+}
+
 int llutil_listlocalfuncs(lua_State *L) {
 	lua_Debug ar;
 
@@ -184,6 +273,15 @@ int llutil_getlocals(lua_State *L, int level, bool checkLocal,
 }
 
 
+/// Convert the number to the string as same as lua_tostring.
+/** The value isn't pushed, so lua needn't create a new string object.
+ */
+static std::string llutil_numbertostring(lua_State *L, int idx) {
+	char buffer[LUAI_MAXNUMBER2STR];
+	lua_number2str(buffer, lua_tonumber(L, idx));
+	return std::string(buffer);
+}
+
 std::string llutil_tostring_fast(lua_State *L, int idx) {
 	scoped_lua scoped(L);
 	int type = lua_type(L, idx);
@@ -201,9 +299,7 @@ std::string llutil_tostring_fast(lua_State *L, int idx) {
 		str = (lua_toboolean(L, idx) ? "true" : "false");
 		break;
 	case LUA_TNUMBER:
-		lua_pushvalue(L, idx);
-		str = lua_tostring(L, -1);
-		lua_pop(L, 1);
+		str = llutil_numbertostring(L, idx);
 		break;
 	case LUA_TSTRING:
 		str = lua_tostring(L, idx);
@@ -254,76 +350,210 @@ int llutil_lua_tostring(lua_State *L) {
 }
 
 
-/// Make a string of 'LuaVar' value.
-/** It doesn't use any lua functions.
- */
-static std::string llutil_tostring_for_varvalue_default(lua_State *L, int idx) {
+/// Push the string of 'LuaVar' value without calling '__tostring'.
+static void llutil_pushvarvalue_raw(lua_State *L, int idx) {
 	scoped_lua scoped(L);
-	std::string result;
-
-	if (luaL_callmeta(L, idx, "__tostring") != 0) {
-		const char *cstr = lua_tostring(L, -1);
-		result = (cstr != NULL ? cstr : "");
-		lua_pop(L, 1);
-		scoped.check(0);
-		return result;
-	}
 
 	switch (lua_type(L, idx)) {
 	case LUA_TNONE:
 	case LUA_TNIL:
-		result = "nil";
+		lua_pushliteral(L, "nil");
 		break;
 	case LUA_TBOOLEAN:
-		result = (lua_toboolean(L, idx) ? "true" : "false");
-		break;
-	case LUA_TNUMBER:
-		lua_pushvalue(L, idx);
-		result = lua_tostring(L, -1);
-		lua_pop(L, 1);
+		lua_pushstring(L, lua_toboolean(L, idx) ? "true" : "false");
 		break;
+	case LUA_TNUMBER: {
+		std::string str = llutil_numbertostring(L, idx);
+		lua_pushlstring(L, str.c_str(), str.length());
+		} break;
 	case LUA_TSTRING:
-		result = lua_tostring(L, idx);
+		lua_pushvalue(L, idx);
 		break;
 	default: {
 		// Use snprintf to avoid lua_pushfstring's bug.
 		char buffer[512];
 		snprintf(buffer, sizeof(buffer), "%p", lua_topointer(L, idx));
-		result = buffer;
+		lua_pushstring(L, buffer);
 		} break;
 	}
 
-	scoped.check(0);
-	return result;
+	scoped.check(1);
+}
+
+/// Push the string of 'LuaVar' value.
+/** It doesn't use any lua functions except '__tostring'.
+ */
+static void llutil_pushvarvalue_default(lua_State *L, int idx) {
+	scoped_lua scoped(L);
+
+	if (luaL_callmeta(L, idx, "__tostring") != 0) {
+		if (!lua_isstring(L, -1)) {
+			lua_pop(L, 1);
+			lua_pushliteral(L, "");
+		}
+		scoped.check(1);
+		return;
+	}
+
+	llutil_pushvarvalue_raw(L, idx);
+	scoped.check(1);
 }
 
 /// Make a string of 'LuaVar' value.
-/** It calls 'llutil_tostring_for_varvalue_default' function.
+/** It calls 'llutil_pushvarvalue_default' function.
  */
 static int llutil_lua_tostring_for_varvalue_default(lua_State *L) {
-	std::string str = llutil_tostring_for_varvalue_default(L, 1);
-	lua_pushlstring(L, str.c_str(), str.length());
+	llutil_pushvarvalue_default(L, 1);
 	return 1;
 }
 
-std::string llutil_tostring_for_varvalue(lua_State *L, int idx) {
+bool llutil_isnativeformatter(lua_State *L) {
 	scoped_lua scoped(L);
 
 	if (llutil_rawget(L, "tostring_for_varvalue") == 0) {
 		scoped.check(0);
-		return llutil_tostring_for_varvalue_default(L, idx);
+		return true;
 	}
 
-	// Call 'lldebug.tostring_for_varvalue'
-	lua_pushvalue(L, idx);
+	bool result =
+		(lua_isnil(L, -1) ||
+		 lua_tocfunction(L, -1) == llutil_lua_tostring_for_varvalue_default);
+	lua_pop(L, 1);
+	scoped.check(0);
+	return result;
+}
+
+static int llutil_pushformatted(lua_State *L, int idx);
+static int llutil_pushcachedstring(lua_State *L, int idx);
+static void llutil_cachestring(lua_State *L, int idx);
+
+/// Push the string of the value(1) made by the formatters or '__tostring'.
+/** It's called by lua_pcall, so their errors and the eval budget
+ * don't jump over the debugger. The argument(2) is 'isNativeFormatter'.
+ */
+static int llutil_lua_formatvarvalue(lua_State *L) {
+	// The registered native formatter is used first.
+	if (llutil_pushformatted(L, 1) == 0) {
+		return 1;
+	}
+
+	if (lua_toboolean(L, 2) || llutil_rawget(L, "tostring_for_varvalue") == 0) {
+		llutil_pushvarvalue_default(L, 1);
+		return 1;
+	}
+
+	// Call 'lldebug.tostring_for_varvalue', the default is used if it fails.
+	lua_pushvalue(L, 1);
 	if (lua_pcall(L, 1, 1, 0) != 0) {
 		lua_pop(L, 1);
-		scoped.check(0);
-		return llutil_tostring_for_varvalue_default(L, idx);
+		llutil_pushvarvalue_default(L, 1);
+	}
+	else if (!lua_isstring(L, -1)) {
+		lua_pop(L, 1);
+		lua_pushliteral(L, "");
 	}
 
-	const char *cstr = lua_tostring(L, -1);
-	std::string str = (cstr != NULL ? cstr : "");
+	return 1;
+}
+
+/// Push the string of 'LuaVar' value.
+/** The formatters and '__tostring' may make a long string,
+ * so the result is left in lua and only the needed part is copied.
+ * The strings made by them are cached until the update count is changed.
+ */
+static void llutil_pushvarvalue(lua_State *L, int idx,
+								bool isNativeFormatter) {
+	scoped_lua scoped(L);
+
+	if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+		idx = lua_gettop(L) + idx + 1;
+	}
+
+	// Numbers, booleans and strings without '__tostring' are cheap.
+	int type = lua_type(L, idx);
+	bool isCheap = isNativeFormatter
+		&& (type == LUA_TNONE || type == LUA_TNIL
+			|| type == LUA_TBOOLEAN || type == LUA_TNUMBER);
+	if (isNativeFormatter && type == LUA_TSTRING) {
+		isCheap = (luaL_getmetafield(L, idx, "__tostring") == 0);
+		if (!isCheap) {
+			lua_pop(L, 1);
+		}
+	}
+	if (isCheap) {
+		llutil_pushvarvalue_default(L, idx);
+		scoped.check(1);
+		return;
+	}
+
+	if (llutil_pushcachedstring(L, idx) == 0) {
+		scoped.check(1);
+		return;
+	}
+
+	// If the formatting fails or exceeds the eval budget,
+	// the value is shown without calling anything.
+	lua_pushcfunction(L, llutil_lua_formatvarvalue);
+	lua_pushvalue(L, idx);
+	lua_pushboolean(L, isNativeFormatter);
+	if (lua_pcall(L, 2, 1, 0) != 0) {
+		lua_pop(L, 1);
+		llutil_pushvarvalue_raw(L, idx);
+	}
+
+	llutil_cachestring(L, idx);
+	scoped.check(1);
+}
+
+std::string llutil_tostring_for_varvalue(lua_State *L, int idx,
+										 bool isNativeFormatter) {
+	scoped_lua scoped(L);
+
+	llutil_pushvarvalue(L, idx, isNativeFormatter);
+	size_t length;
+	const char *cstr = lua_tolstring(L, -1, &length);
+	std::string str(cstr, length);
+	lua_pop(L, 1);
+	scoped.check(0);
+	return str;
+}
+
+/// Get the length of [offset, offset + maxLength) in the 'length' bytes string.
+/** If the string is cut, the end is moved not to split the utf8 character.
+ */
+static size_t llutil_slicelength(const char *str, size_t length,
+								 size_t offset, int maxLength) {
+	if (offset >= length) {
+		return 0;
+	}
+
+	size_t n = length - offset;
+	if (maxLength < 0 || n <= (size_t)maxLength) {
+		return n;
+	}
+
+	n = (size_t)maxLength;
+	while (n > 0 && (str[offset + n] & 0xC0) == 0x80) {
+		--n;
+	}
+	return n;
+}
+
+std::string llutil_tostring_for_varslice(lua_State *L, int idx,
+										 bool isNativeFormatter,
+										 int offset, int maxLength,
+										 int &length) {
+	scoped_lua scoped(L);
+	size_t first = (size_t)(offset < 0 ? 0 : offset);
+
+	// The string is cut in lua without copying the whole string.
+	llutil_pushvarvalue(L, idx, isNativeFormatter);
+	size_t len;
+	const char *cstr = lua_tolstring(L, -1, &len);
+	size_t n = llutil_slicelength(cstr, len, first, maxLength);
+	std::string str(cstr + (n > 0 ? first : 0), n);
+
+	length = (int)len;
 	lua_pop(L, 1);
 	scoped.check(0);
 	return str;
@@ -439,9 +669,613 @@ int llutil_lua_tostring_detail(lua_State *L) {
 
 
 /*-----------------------------------------------------------------*/
-static int llutil_get_luavar_table(lua_State *L) {
+/// Indices of the handle table, registry[&llutil_address_for_internal_table].
+enum {
+	HANDLETABLE_OBJECTS = 1, ///< slot -> object (weak values)
+	HANDLETABLE_SLOTS, ///< object -> slot (weak keys)
+	HANDLETABLE_GENERATIONS, ///< slot -> generation, minus if the slot is free
+	HANDLETABLE_FREELIST, ///< stack of the free slots, [0] is its size
+	HANDLETABLE_SIZE, ///< count of the allocated slots
+	HANDLETABLE_SWEEP, ///< the slot that will be checked next
+	HANDLETABLE_KEPTVALUES, ///< index -> kept value, [0] is its size
+	HANDLETABLE_KEPTINDICES, ///< kept value -> index
+	HANDLETABLE_EVALCHUNKS, ///< key -> compiled eval function, [0] is its size
+	HANDLETABLE_FORMATTERS, ///< metatable -> native formatter (weak keys)
+	HANDLETABLE_VALUESTRINGS, ///< value -> formatted string, cleared with the kept values
+	HANDLETABLE_THREADS, ///< marked thread -> true (weak keys)
+};
+
+/// Count of the slots that are checked whenever an object is registered.
+static const int HANDLETABLE_SWEEP_STEP = 2;
+
+static int handle_geti(lua_State *L, int table, int n) {
+	lua_rawgeti(L, table, n);
+	int result = (int)lua_tonumber(L, -1);
+	lua_pop(L, 1);
+	return result;
+}
+
+static void handle_seti(lua_State *L, int table, int n, int value) {
+	lua_pushnumber(L, (lua_Number)value);
+	lua_rawseti(L, table, n);
+}
+
+/// Push the weak table that has 'mode'.
+static void handle_newweaktable(lua_State *L, const char *mode) {
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushliteral(L, "__mode");
+	lua_pushstring(L, mode);
+	lua_rawset(L, -3);
+	lua_setmetatable(L, -2);
+}
+
+/// Push the handle table, it's made if 'create' is true.
+static int handle_pushtable(lua_State *L, bool create) {
 	lua_pushlightuserdata(L, (void *)&llutil_address_for_internal_table);
 	lua_rawget(L, LUA_REGISTRYINDEX);
+	if (lua_istable(L, -1) || !create) {
+		return lua_istable(L, -1);
+	}
+	lua_pop(L, 1);
+
+	lua_newtable(L);
+	int table = lua_gettop(L);
+
+	handle_newweaktable(L, "v");
+	lua_rawseti(L, table, HANDLETABLE_OBJECTS);
+	handle_newweaktable(L, "k");
+	lua_rawseti(L, table, HANDLETABLE_SLOTS);
+	lua_newtable(L);
+	lua_rawseti(L, table, HANDLETABLE_GENERATIONS);
+	lua_newtable(L);
+	handle_seti(L, lua_gettop(L), 0, 0);
+	lua_rawseti(L, table, HANDLETABLE_FREELIST);
+	handle_seti(L, table, HANDLETABLE_SIZE, 0);
+	handle_seti(L, table, HANDLETABLE_SWEEP, 1);
+	lua_newtable(L);
+	handle_seti(L, lua_gettop(L), 0, 0);
+	lua_rawseti(L, table, HANDLETABLE_KEPTVALUES);
+	lua_newtable(L);
+	lua_rawseti(L, table, HANDLETABLE_KEPTINDICES);
+	lua_newtable(L);
+	handle_seti(L, lua_gettop(L), 0, 0);
+	lua_rawseti(L, table, HANDLETABLE_EVALCHUNKS);
+	lua_newtable(L);
+	lua_rawseti(L, table, HANDLETABLE_VALUESTRINGS);
+
+	// registry[&OriginalObj] = table
+	lua_pushlightuserdata(L, (void *)&llutil_address_for_internal_table);
+	lua_pushvalue(L, table);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+	return 1;
+}
+
+/// Return the slot to the free list and advance its generation.
+/** The table indices are of the handle table's components.
+ */
+static void handle_freeslot(lua_State *L, int objects, int gens,
+							int freelist, int slot) {
+	int generation = handle_geti(L, gens, slot);
+	if (generation <= 0) {
+		return;
+	}
+
+	lua_pushnil(L);
+	lua_rawseti(L, objects, slot);
+	handle_seti(L, gens, slot, -(generation + 1));
+
+	int n = handle_geti(L, freelist, 0) + 1;
+	handle_seti(L, freelist, n, slot);
+	handle_seti(L, freelist, 0, n);
+}
+
+int llutil_registerhandle(lua_State *L, int idx, int &generation) {
+	scoped_lua scoped(L);
+
+	if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+		idx = lua_gettop(L) + idx + 1;
+	}
+
+	handle_pushtable(L, true);
+	int table = lua_gettop(L);
+	lua_rawgeti(L, table, HANDLETABLE_OBJECTS);
+	lua_rawgeti(L, table, HANDLETABLE_SLOTS);
+	lua_rawgeti(L, table, HANDLETABLE_GENERATIONS);
+	lua_rawgeti(L, table, HANDLETABLE_FREELIST);
+	int objects = table + 1, slots = table + 2;
+	int gens = table + 3, freelist = table + 4;
+
+	// Is the object registered already ?
+	lua_pushvalue(L, idx);
+	lua_rawget(L, slots);
+	if (lua_isnumber(L, -1)) {
+		int slot = (int)lua_tonumber(L, -1);
+		lua_pop(L, 1);
+
+		lua_rawgeti(L, objects, slot);
+		bool isSame = (lua_rawequal(L, -1, idx) != 0);
+		lua_pop(L, 1);
+
+		if (isSame && handle_geti(L, gens, slot) > 0) {
+			generation = handle_geti(L, gens, slot);
+			lua_pop(L, 5);
+			scoped.check(0);
+			return slot;
+		}
+	}
+	else {
+		lua_pop(L, 1);
+	}
+
+	// Free a few slots whose object has been collected, so that
+	// the table doesn't grow even if the weak values are cleared.
+	int size = handle_geti(L, table, HANDLETABLE_SIZE);
+	if (size > 0) {
+		int sweep = handle_geti(L, table, HANDLETABLE_SWEEP);
+
+		for (int i = 0; i < HANDLETABLE_SWEEP_STEP; ++i, ++sweep) {
+			if (sweep > size) {
+				sweep = 1;
+			}
+
+			lua_rawgeti(L, objects, sweep);
+			if (lua_isnil(L, -1)) {
+				handle_freeslot(L, objects, gens, freelist, sweep);
+			}
+			lua_pop(L, 1);
+		}
+
+		handle_seti(L, table, HANDLETABLE_SWEEP, sweep);
+	}
+
+	// Allocate a slot, the free slot is used first.
+	int slot;
+	int n = handle_geti(L, freelist, 0);
+	if (n > 0) {
+		slot = handle_geti(L, freelist, n);
+		lua_pushnil(L);
+		lua_rawseti(L, freelist, n);
+		handle_seti(L, freelist, 0, n - 1);
+		generation = -handle_geti(L, gens, slot);
+	}
+	else {
+		slot = size + 1;
+		handle_seti(L, table, HANDLETABLE_SIZE, slot);
+		generation = 1;
+	}
+	handle_seti(L, gens, slot, generation);
+
+	// objects[slot] = obj, slots[obj] = slot
+	lua_pushvalue(L, idx);
+	lua_rawseti(L, objects, slot);
+	lua_pushvalue(L, idx);
+	lua_pushnumber(L, (lua_Number)slot);
+	lua_rawset(L, slots);
+
+	lua_pop(L, 5);
+	scoped.check(0);
+	return slot;
+}
+
+int llutil_pushhandle(lua_State *L, int slot, int generation) {
+	scoped_lua scoped(L);
+
+	if (slot <= 0 || generation <= 0) {
+		return -1;
+	}
+
+	if (!handle_pushtable(L, false)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return -1;
+	}
+
+	int table = lua_gettop(L);
+	lua_rawgeti(L, table, HANDLETABLE_OBJECTS);
+	lua_rawgeti(L, table, HANDLETABLE_GENERATIONS);
+	int objects = table + 1, gens = table + 2;
+
+	// The handle of the older generation is rejected.
+	if (handle_geti(L, gens, slot) != generation) {
+		lua_pop(L, 3);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_rawgeti(L, objects, slot);
+	if (lua_isnil(L, -1)) {
+		lua_pop(L, 1);
+
+		// The object was collected, so the slot can be reused.
+		lua_rawgeti(L, table, HANDLETABLE_FREELIST);
+		handle_freeslot(L, objects, gens, lua_gettop(L), slot);
+		lua_pop(L, 4);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_replace(L, table);
+	lua_pop(L, 2);
+	scoped.check(1);
+	return 0;
+}
+
+int llutil_keepvalue(lua_State *L, int idx) {
+	scoped_lua scoped(L);
+
+	if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+		idx = lua_gettop(L) + idx + 1;
+	}
+
+	handle_pushtable(L, true);
+	int table = lua_gettop(L);
+	lua_rawgeti(L, table, HANDLETABLE_KEPTVALUES);
+	lua_rawgeti(L, table, HANDLETABLE_KEPTINDICES);
+	int values = table + 1, indices = table + 2;
+
+	// Is the value kept already ?
+	lua_pushvalue(L, idx);
+	lua_rawget(L, indices);
+	if (lua_isnumber(L, -1)) {
+		int n = (int)lua_tonumber(L, -1);
+		lua_pop(L, 4);
+		scoped.check(0);
+		return n;
+	}
+	lua_pop(L, 1);
+
+	// values[n] = obj, indices[obj] = n
+	int n = handle_geti(L, values, 0) + 1;
+	handle_seti(L, values, 0, n);
+	lua_pushvalue(L, idx);
+	lua_rawseti(L, values, n);
+	lua_pushvalue(L, idx);
+	lua_pushnumber(L, (lua_Number)n);
+	lua_rawset(L, indices);
+
+	lua_pop(L, 3);
+	scoped.check(0);
+	return n;
+}
+
+int llutil_pushkeptvalue(lua_State *L, int n) {
+	scoped_lua scoped(L);
+
+	if (n <= 0) {
+		return -1;
+	}
+
+	if (!handle_pushtable(L, false)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_rawgeti(L, -1, HANDLETABLE_KEPTVALUES);
+	lua_rawgeti(L, -1, n);
+	lua_replace(L, -3);
+	lua_pop(L, 1);
+	if (lua_isnil(L, -1)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return -1;
+	}
+
+	scoped.check(1);
+	return 0;
+}
+
+void llutil_clearkeptvalues(lua_State *L) {
+	scoped_lua scoped(L);
+
+	if (!handle_pushtable(L, false)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return;
+	}
+
+	int table = lua_gettop(L);
+	lua_newtable(L);
+	handle_seti(L, lua_gettop(L), 0, 0);
+	lua_rawseti(L, table, HANDLETABLE_KEPTVALUES);
+	lua_newtable(L);
+	lua_rawseti(L, table, HANDLETABLE_KEPTINDICES);
+	lua_newtable(L);
+	lua_rawseti(L, table, HANDLETABLE_VALUESTRINGS);
+	lua_pop(L, 1);
+	scoped.check(0);
+}
+
+void llutil_markthread(lua_State *L, int idx) {
+	scoped_lua scoped(L);
+
+	if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+		idx = lua_gettop(L) + idx + 1;
+	}
+
+	if (!lua_isthread(L, idx)) {
+		return;
+	}
+
+	handle_pushtable(L, true);
+	lua_rawgeti(L, -1, HANDLETABLE_THREADS);
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 1);
+		handle_newweaktable(L, "k");
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, HANDLETABLE_THREADS);
+	}
+
+	// threads[thread] = true
+	lua_pushvalue(L, idx);
+	lua_pushboolean(L, 1);
+	lua_rawset(L, -3);
+	lua_pop(L, 2);
+	scoped.check(0);
+}
+
+void llutil_getmarkedthreads(lua_State *L, std::set<lua_State *> &threads) {
+	scoped_lua scoped(L);
+
+	if (!handle_pushtable(L, false)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return;
+	}
+
+	lua_rawgeti(L, -1, HANDLETABLE_THREADS);
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 2);
+		scoped.check(0);
+		return;
+	}
+
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		lua_State *co = lua_tothread(L, -2);
+		if (co != NULL) {
+			threads.insert(co);
+		}
+		lua_pop(L, 1);
+	}
+
+	lua_pop(L, 2);
+	scoped.check(0);
+}
+
+/// Push the string of the value(idx) that was cached at this update.
+/** It returns -1 without pushing anything if it isn't cached.
+ */
+static int llutil_pushcachedstring(lua_State *L, int idx) {
+	scoped_lua scoped(L);
+
+	if (lua_isnoneornil(L, idx)) {
+		return -1;
+	}
+
+	if (!handle_pushtable(L, false)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_rawgeti(L, -1, HANDLETABLE_VALUESTRINGS);
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 2);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_pushvalue(L, idx);
+	lua_rawget(L, -2);
+	if (!lua_isstring(L, -1)) {
+		lua_pop(L, 3);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_replace(L, -3);
+	lua_pop(L, 1);
+	scoped.check(1);
+	return 0;
+}
+
+/// Cache the string on the top as the string of the value(idx).
+static void llutil_cachestring(lua_State *L, int idx) {
+	scoped_lua scoped(L);
+
+	if (lua_isnoneornil(L, idx)) {
+		return;
+	}
+
+	handle_pushtable(L, true);
+	lua_rawgeti(L, -1, HANDLETABLE_VALUESTRINGS);
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, HANDLETABLE_VALUESTRINGS);
+	}
+
+	// strings[value] = string
+	lua_pushvalue(L, idx);
+	lua_pushvalue(L, -4);
+	lua_rawset(L, -3);
+	lua_pop(L, 2);
+	scoped.check(0);
+}
+
+int llutil_registerformatter(lua_State *L, int idx,
+							 lldebug_Formatter formatter) {
+	scoped_lua scoped(L);
+
+	if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+		idx = lua_gettop(L) + idx + 1;
+	}
+
+	if (!lua_istable(L, idx)) {
+		return -1;
+	}
+
+	// The formatters table is made only when it's used,
+	// so nothing is looked up if there are no formatters.
+	handle_pushtable(L, true);
+	int table = lua_gettop(L);
+	lua_rawgeti(L, table, HANDLETABLE_FORMATTERS);
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 1);
+		handle_newweaktable(L, "k");
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, table, HANDLETABLE_FORMATTERS);
+	}
+
+	// formatters[metatable] = userdata(formatter)
+	lua_pushvalue(L, idx);
+	if (formatter != NULL) {
+		lldebug_Formatter *p = (lldebug_Formatter *)
+			lua_newuserdata(L, sizeof(lldebug_Formatter));
+		*p = formatter;
+	}
+	else {
+		lua_pushnil(L);
+	}
+	lua_rawset(L, -3);
+
+	lua_pop(L, 2);
+	scoped.check(0);
+	return 0;
+}
+
+/// Push the string of the value(idx) made by the formatter registered to its metatable.
+/** It returns -1 without pushing anything
+ * if there is no formatter or the formatter refuses it.
+ */
+static int llutil_pushformatted(lua_State *L, int idx) {
+	scoped_lua scoped(L);
+	int type = lua_type(L, idx);
+
+	if (type != LUA_TUSERDATA && type != LUA_TTABLE) {
+		return -1;
+	}
+
+	if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+		idx = lua_gettop(L) + idx + 1;
+	}
+
+	if (lua_getmetatable(L, idx) == 0) {
+		return -1;
+	}
+
+	if (!handle_pushtable(L, false)) {
+		lua_pop(L, 2);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_rawgeti(L, -1, HANDLETABLE_FORMATTERS);
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 3);
+		scoped.check(0);
+		return -1;
+	}
+
+	// formatters[metatable]
+	lua_pushvalue(L, -3);
+	lua_rawget(L, -2);
+	lldebug_Formatter *p = (lldebug_Formatter *)lua_touserdata(L, -1);
+	lldebug_Formatter formatter = (p != NULL ? *p : NULL);
+	lua_pop(L, 4);
+	if (formatter == NULL) {
+		scoped.check(0);
+		return -1;
+	}
+
+	int top = lua_gettop(L);
+	if (formatter(L, idx) <= 0 || lua_gettop(L) <= top) {
+		lua_settop(L, top);
+		scoped.check(0);
+		return -1;
+	}
+
+	if (!lua_isstring(L, -1)) {
+		lua_settop(L, top);
+		scoped.check(0);
+		return -1;
+	}
+
+	// Leave only the result.
+	lua_tostring(L, -1);
+	lua_replace(L, top + 1);
+	lua_settop(L, top + 1);
+	scoped.check(1);
+	return 0;
+}
+
+int llutil_pushevalchunk(lua_State *L, const std::string &key) {
+	scoped_lua scoped(L);
+
+	if (!handle_pushtable(L, false)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return -1;
+	}
+
+	lua_rawgeti(L, -1, HANDLETABLE_EVALCHUNKS);
+	lua_pushlstring(L, key.c_str(), key.length());
+	lua_rawget(L, -2);
+	lua_replace(L, -3);
+	lua_pop(L, 1);
+	if (!lua_isfunction(L, -1)) {
+		lua_pop(L, 1);
+		scoped.check(0);
+		return -1;
+	}
+
+	scoped.check(1);
+	return 0;
+}
+
+void llutil_cacheevalchunk(lua_State *L, const std::string &key, int idx,
+						   int maxCount) {
+	scoped_lua scoped(L);
+
+	if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+		idx = lua_gettop(L) + idx + 1;
+	}
+
+	handle_pushtable(L, true);
+	int table = lua_gettop(L);
+	lua_rawgeti(L, table, HANDLETABLE_EVALCHUNKS);
+	int chunks = table + 1;
+
+	// The cache is rebuilt simply when it's full,
+	// the frequent watch exprs will be cached again soon.
+	int n = handle_geti(L, chunks, 0);
+	if (n >= maxCount) {
+		lua_pop(L, 1);
+		lua_newtable(L);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, table, HANDLETABLE_EVALCHUNKS);
+		n = 0;
+	}
+
+	lua_pushlstring(L, key.c_str(), key.length());
+	lua_pushvalue(L, idx);
+	lua_rawset(L, chunks);
+	handle_seti(L, chunks, 0, n + 1);
+
+	lua_pop(L, 2);
+	scoped.check(0);
+}
+
+static int llutil_get_luavar_table(lua_State *L) {
+	if (!handle_pushtable(L, false)) {
+		return 1;
+	}
+
+	lua_rawgeti(L, -1, HANDLETABLE_OBJECTS);
+	lua_remove(L, -2);
 	return 1;
 }
 
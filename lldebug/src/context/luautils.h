@@ -27,6 +27,8 @@
 #ifndef __LLDEBUG_LUAUTILS_H__
 #define __LLDEBUG_LUAUTILS_H__
 
+#include "lldebug.h"
+
 namespace lldebug {
 namespace context {
 
@@ -58,6 +60,19 @@ extern const int llutil_address_for_internal_table;
 /// Get the original name of the lua function.
 std::string llutil_makefuncname(lua_Debug *ar);
 
+/// Is the interned 'source' the same as 'key' ?
+/** Only the head is compared, so it's cheap even for the string chunks.
+ * It checks that the pointer of the collected source isn't reused.
+ */
+bool llutil_issamesource(const std::string &key, const char *source);
+
+/// Find the registered name of the C function.
+/** The globals, the modules and the metatables in the registry are
+ * searched, e.g. "print", "string.format" or "FILE*:read".
+ * It returns an empty string if not found.
+ */
+std::string llutil_findcfuncname(lua_State *L, lua_CFunction f);
+
 int llutil_listlocalfuncs(lua_State *L);
 
 /// Clone the table(idx).
@@ -73,6 +88,47 @@ int llutil_setfenv(lua_State *L, int level, int idx);
 int llutil_getlocals(lua_State *L, int level, bool checkLocal,
 					 bool checkUpvalue, bool checkEnv);
 
+/// Register the object(idx) to the handle table.
+/** It returns the slot number (minus if failed), and the generation of
+ * the slot is set to 'generation'. The same object gets the same handle
+ * while it's alive.
+ */
+int llutil_registerhandle(lua_State *L, int idx, int &generation);
+
+/// Push the object that is registered to the handle table.
+/** Handles whose object has been collected or whose generation is old
+ * are rejected and it returns -1 without pushing anything.
+ */
+int llutil_pushhandle(lua_State *L, int slot, int generation);
+
+/// Keep the object(idx) until 'llutil_clearkeptvalues' is called.
+/** It returns the index of the kept value. The same object gets the same index.
+ */
+int llutil_keepvalue(lua_State *L, int idx);
+
+/// Push the kept value, it returns -1 if the value doesn't exist.
+int llutil_pushkeptvalue(lua_State *L, int n);
+
+/// Release all kept values.
+void llutil_clearkeptvalues(lua_State *L);
+
+/// Mark the thread(idx) until it's collected.
+void llutil_markthread(lua_State *L, int idx);
+
+/// Get the marked threads that haven't been collected.
+void llutil_getmarkedthreads(lua_State *L, std::set<lua_State *> &threads);
+
+/// Push the compiled eval function that is cached by 'key'.
+/** It returns -1 without pushing anything if it isn't cached.
+ */
+int llutil_pushevalchunk(lua_State *L, const std::string &key);
+
+/// Cache the compiled eval function(idx) by 'key'.
+/** All cached functions are released if there are 'maxCount' ones.
+ */
+void llutil_cacheevalchunk(lua_State *L, const std::string &key, int idx,
+						   int maxCount);
+
 
 /// Convert to the string.
 /** It doesn't use any lua functions
@@ -90,11 +146,34 @@ std::string llutil_tostring(lua_State *L, int idx);
  */
 int llutil_lua_tostring(lua_State *L);
 
+/// Is 'lldebug.tostring_for_varvalue' the native default formatter ?
+bool llutil_isnativeformatter(lua_State *L);
+
+/// Register the native formatter for the values that have the metatable(idx).
+/** If 'formatter' is NULL, the formatter is removed.
+ */
+int llutil_registerformatter(lua_State *L, int idx,
+							 lldebug_Formatter formatter);
+
 /// Make a string of 'LuaVar' value.
 /** It calls 'lldebug.tostring_for_varvalue' first,
  * if failed it calls the default function.
+ * If 'isNativeFormatter' is true, the default is called directly
+ * without looking up the 'lldebug' table.
+ * The native formatter registered to the metatable is used before all.
+ */
+std::string llutil_tostring_for_varvalue(lua_State *L, int idx,
+										 bool isNativeFormatter = false);
+
+/// Make a part of the string of 'LuaVar' value.
+/** The result is [offset, offset + maxLength) of the whole string,
+ * (no limit if 'maxLength' is minus) and the whole length is set to 'length'.
+ * The lua string is copied only as long as the result.
  */
-std::string llutil_tostring_for_varvalue(lua_State *L, int idx);
+std::string llutil_tostring_for_varslice(lua_State *L, int idx,
+										 bool isNativeFormatter,
+										 int offset, int maxLength,
+										 int &length);
 
 /// Make a detail string of the lua object.
 int llutil_lua_tostring_detail(lua_State *L);
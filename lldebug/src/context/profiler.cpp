@@ -0,0 +1,926 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "precomp.h"
+#include "context/profiler.h"
+#include "context/luautils.h"
+
+#include <algorithm>
+#include <limits.h>
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32)
+#include <time.h>
+#endif
+
+/// The max depth of the sampled call stack.
+#ifndef LLDEBUG_PROFILE_MAXDEPTH
+#define LLDEBUG_PROFILE_MAXDEPTH 256
+#endif
+
+/// The count of the coroutines that are kept without pruning.
+#ifndef LLDEBUG_PROFILE_PRUNESIZE
+#define LLDEBUG_PROFILE_PRUNESIZE 64
+#endif
+
+namespace lldebug {
+namespace context {
+
+Profiler::Cost Profiler::GetMonotonicTime() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
+	static LARGE_INTEGER s_frequency;
+	LARGE_INTEGER counter;
+
+	if (s_frequency.QuadPart == 0) {
+		::QueryPerformanceFrequency(&s_frequency);
+	}
+	::QueryPerformanceCounter(&counter);
+
+	// Avoid the overflow of 'counter * 1000000'.
+	Profiler::Cost freq = s_frequency.QuadPart;
+	Profiler::Cost count = counter.QuadPart;
+	return (count / freq * 1000000 + count % freq * 1000000 / freq);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((Profiler::Cost)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#endif
+}
+
+/// Convert the cost to the string.
+static std::string CostToString(Profiler::Cost cost) {
+	return boost::lexical_cast<std::string>(cost);
+}
+
+Profiler::Profiler()
+	: m_sampleCount(0), m_sampleCost(0), m_intervalScale(1), m_maxScale(1)
+	, m_pruneSize(LLDEBUG_PROFILE_PRUNESIZE)
+	, m_startTime(0), m_elapsedTime(0)
+	, m_isRunning(false), m_mode(LLDEBUG_PROFILEMODE_SAMPLING)
+	, m_sampleInterval(LLDEBUG_DEFAULT_SAMPLEINTERVAL) {
+	Clear();
+}
+
+Profiler::~Profiler() {
+}
+
+void Profiler::Start(lldebug_ProfileMode mode, int interval) {
+	Clear();
+
+	m_mode = mode;
+	m_sampleInterval = (interval > 0 ? interval
+		: mode == LLDEBUG_PROFILEMODE_INSTRUCTIONS ? LLDEBUG_DEFAULT_COUNTINTERVAL
+		: LLDEBUG_DEFAULT_SAMPLEINTERVAL);
+	m_startTime = GetMonotonicTime();
+	m_isRunning = true;
+}
+
+void Profiler::Stop() {
+	if (!m_isRunning) {
+		return;
+	}
+
+	Cost now = GetMonotonicTime();
+
+	// The running calls are closed at this time.
+	ThreadStackMap::iterator it;
+	for (it = m_threads.begin(); it != m_threads.end(); ++it) {
+		ThreadStack &stack = it->second;
+		if (stack.suspended != 0) {
+			stack.paused += now - stack.suspended;
+			stack.suspended = 0;
+		}
+		while (!stack.frames.empty()) {
+			PopFrame(stack, now);
+		}
+	}
+	m_threads.clear();
+
+	m_elapsedTime = now - m_startTime;
+	m_isRunning = false;
+}
+
+int Profiler::GetSampleInterval() const {
+	if (m_intervalScale > INT_MAX / m_sampleInterval) {
+		return INT_MAX;
+	}
+
+	return (m_sampleInterval * m_intervalScale);
+}
+
+void Profiler::SetIntervalScale(int scale) {
+	m_intervalScale = (scale > 0 ? scale : 1);
+	if (m_intervalScale > m_maxScale) {
+		m_maxScale = m_intervalScale;
+	}
+}
+
+void Profiler::Clear() {
+	m_funcIds.clear();
+	m_funcs.clear();
+	m_nodes.clear();
+	m_nodes.push_back(Node());
+	m_threads.clear();
+	m_sampleCount = 0;
+	m_sampleCost = 0;
+	m_maxScale = m_intervalScale;
+	m_lineSamples.clear();
+	m_lineSampleIds.clear();
+	m_lineSampleNames.clear();
+	m_lastLineSource = NULL;
+	m_lastLineSampleId = -1;
+	m_elapsedTime = 0;
+
+	for (size_t i = 0; i < m_kinds.size(); ++i) {
+		m_kinds[i].func = -1;
+		m_kinds[i].resumes = 0;
+		m_kinds[i].cost = 0;
+	}
+}
+
+/// Get the id of the function, the new function is registered.
+/** The lua functions are identified by the source and the defined line,
+ * and the C functions are identified by their pointers.
+ */
+int Profiler::InternFunc(lua_State *L, lua_Debug *ar) {
+	lua_CFunction cfunc = NULL;
+	const void *key;
+	int line;
+
+	if (*ar->what == 'C') {
+		lua_getinfo(L, "f", ar);
+		cfunc = lua_tocfunction(L, -1);
+		lua_pop(L, 1);
+		key = (const void *)cfunc;
+		line = -1;
+	}
+	else if (*ar->what == 't') {
+		key = NULL; // tail call
+		line = -1;
+	}
+	else {
+		key = ar->source;
+		line = ar->linedefined;
+	}
+
+	FuncIdMap::key_type funcKey(key, line);
+	FuncIdMap::iterator it = m_funcIds.find(funcKey);
+	if (it != m_funcIds.end()) {
+		return it->second;
+	}
+
+	// The name is made only once for each function.
+	// The C function is named by the registered name if found,
+	// because it's often called through the local variables.
+	FuncInfo info;
+	if (cfunc != NULL) {
+		info.name = llutil_findcfuncname(L, cfunc);
+	}
+	if (info.name.empty()) {
+		lua_getinfo(L, "n", ar);
+		info.name = llutil_makefuncname(ar);
+	}
+	info.source = ar->short_src;
+	info.line = ar->linedefined;
+	info.isNative = (*ar->what == 'C');
+
+	int id = (int)m_funcs.size();
+	m_funcs.push_back(info);
+	m_funcIds.insert(std::make_pair(funcKey, id));
+	return id;
+}
+
+/// Get the kind of the coroutine, NULL if it's unknown.
+Profiler::CoroutineKind *Profiler::FindKind(lua_State *co) {
+	std::map<lua_State *, int>::iterator it = m_threadKinds.find(co);
+	return (it != m_threadKinds.end() ? &m_kinds[it->second] : NULL);
+}
+
+/// Get the id of the function that stands for the kind of the coroutines.
+int Profiler::InternKindFunc(CoroutineKind &kind) {
+	if (kind.func < 0) {
+		FuncInfo info;
+		info.name = "coroutine";
+		info.source = kind.source;
+		info.line = kind.line;
+		info.isNative = false;
+
+		kind.func = (int)m_funcs.size();
+		m_funcs.push_back(info);
+	}
+
+	return kind.func;
+}
+
+int Profiler::GetChildNode(int node, int func) {
+	std::map<int, int> &children = m_nodes[node].children;
+	std::map<int, int>::iterator it = children.find(func);
+	if (it != children.end()) {
+		return it->second;
+	}
+
+	int child = (int)m_nodes.size();
+	m_nodes.push_back(Node(func, node));
+	m_nodes[node].children.insert(std::make_pair(func, child));
+	return child;
+}
+
+void Profiler::Sample(lua_State *L, int count) {
+	Cost weight = GetSampleWeight(count);
+	lua_Debug ar;
+
+	// The stack is got from the innermost function.
+	m_stack.clear();
+	for (int level = 0; level < LLDEBUG_PROFILE_MAXDEPTH; ++level) {
+		if (lua_getstack(L, level, &ar) == 0) {
+			break;
+		}
+
+		// The current line is needed only for the innermost function.
+		lua_getinfo(L, (level == 0 ? "Sl" : "S"), &ar);
+		if (level == 0 && *ar.what != 'C' && ar.currentline > 0) {
+			std::vector<int> &lines = FindLineSamples(ar.source).lines;
+			size_t line = (size_t)ar.currentline;
+			if (line >= lines.size()) {
+				lines.resize(line + 1, 0);
+			}
+			lines[line] += (int)weight;
+		}
+
+		m_stack.push_back(InternFunc(L, &ar));
+	}
+
+	if (m_stack.empty()) {
+		return;
+	}
+
+	// The kind of the coroutine is the outermost.
+	CoroutineKind *kind = FindKind(L);
+	if (kind != NULL) {
+		m_stack.push_back(InternKindFunc(*kind));
+		kind->cost += weight;
+	}
+
+	// Follow the call tree from the outermost function.
+	int node = 0;
+	m_nodes[node].total += weight;
+	for (std::vector<int>::reverse_iterator it = m_stack.rbegin();
+		it != m_stack.rend(); ++it) {
+		node = GetChildNode(node, *it);
+		m_nodes[node].total += weight;
+	}
+
+	m_nodes[node].self += weight;
+	m_sampleCost += weight;
+	++m_sampleCount;
+}
+
+/// Get the samples of the source, the new source is registered.
+/** It's found by the interned pointer as Coverage::GetSourceId does,
+ * so the string chunks aren't copied at each sample.
+ */
+Profiler::LineSamples &Profiler::FindLineSamples(const char *source) {
+	if (source == m_lastLineSource
+		&& llutil_issamesource(m_lineSamples[m_lastLineSampleId].key, source)) {
+		return m_lineSamples[m_lastLineSampleId];
+	}
+
+	int id;
+	std::map<const char *, int>::iterator it = m_lineSampleIds.find(source);
+	if (it != m_lineSampleIds.end()
+		&& llutil_issamesource(m_lineSamples[it->second].key, source)) {
+		id = it->second;
+	}
+	else {
+		std::map<std::string, int>::iterator nameIt =
+			m_lineSampleNames.find(source);
+		if (nameIt != m_lineSampleNames.end()) {
+			id = nameIt->second;
+		}
+		else {
+			id = (int)m_lineSamples.size();
+			m_lineSamples.push_back(LineSamples());
+			m_lineSamples.back().key = source;
+			m_lineSampleNames.insert(std::make_pair(std::string(source), id));
+		}
+		m_lineSampleIds[source] = id;
+	}
+
+	m_lastLineSource = source;
+	m_lastLineSampleId = id;
+	return m_lineSamples[id];
+}
+
+const std::vector<int> *Profiler::GetLineSamples(const std::string &key) const {
+	std::map<std::string, int>::const_iterator it = m_lineSampleNames.find(key);
+	return (it != m_lineSampleNames.end() ? &m_lineSamples[it->second].lines : NULL);
+}
+
+void Profiler::OnCall(lua_State *L, lua_Debug *ar) {
+	Cost now = GetMonotonicTime();
+	ThreadStack &stack = m_threads[L];
+
+	// The tail call is pushed as the new frame,
+	// and it's popped by the following LUA_HOOKTAILRET.
+	lua_getinfo(L, "S", ar);
+	int parent = (stack.frames.empty() ? stack.base : stack.frames.back().node);
+	Frame frame;
+	frame.node = GetChildNode(parent, InternFunc(L, ar));
+	frame.start = now;
+	frame.children = 0;
+	frame.paused = stack.paused;
+	stack.frames.push_back(frame);
+
+	++m_nodes[frame.node].calls;
+}
+
+void Profiler::OnReturn(lua_State *L, lua_Debug *ar) {
+	Cost now = GetMonotonicTime();
+	ThreadStackMap::iterator it = m_threads.find(L);
+	if (it == m_threads.end() || it->second.frames.empty()) {
+		return;
+	}
+
+	// The frames unwound by the error didn't get their return events,
+	// so they are closed together with the returned function.
+	// The function that was called before the start isn't found.
+	ThreadStack &stack = it->second;
+	lua_getinfo(L, "S", ar);
+	int func = InternFunc(L, ar);
+	size_t size = stack.frames.size();
+	while (size > 0 && m_nodes[stack.frames[size - 1].node].func != func) {
+		--size;
+	}
+	if (size == 0) {
+		return;
+	}
+
+	while (stack.frames.size() >= size) {
+		PopFrame(stack, now);
+	}
+}
+
+void Profiler::OnTailReturn(lua_State *L) {
+	Cost now = GetMonotonicTime();
+	ThreadStackMap::iterator it = m_threads.find(L);
+	if (it == m_threads.end() || it->second.frames.empty()) {
+		return;
+	}
+
+	PopFrame(it->second, now);
+}
+
+/// The kind of the coroutine is the place that called coroutine.create.
+/** The coroutine that was collected may have the same address,
+ * so the old kind is overwritten.
+ */
+void Profiler::OnCreateCoroutine(lua_State *L, lua_State *co) {
+	lua_Debug ar;
+
+	// The stack of the collected coroutine mustn't be inherited.
+	m_threads.erase(co);
+
+	// The level 0 is coroutine.create itself.
+	if (lua_getstack(L, 1, &ar) == 0) {
+		m_threadKinds.erase(co);
+		return;
+	}
+
+	lua_getinfo(L, "Sl", &ar);
+	std::string key = std::string(ar.source) + ":"
+		+ boost::lexical_cast<std::string>(ar.currentline);
+	std::map<std::string, int>::iterator it = m_kindIds.find(key);
+	int id;
+	if (it != m_kindIds.end()) {
+		id = it->second;
+	}
+	else {
+		id = (int)m_kinds.size();
+		m_kinds.push_back(CoroutineKind());
+		m_kinds.back().source = ar.short_src;
+		m_kinds.back().line = ar.currentline;
+		m_kindIds.insert(std::make_pair(key, id));
+	}
+
+	m_threadKinds[co] = id;
+}
+
+void Profiler::BeginCoroutine(lua_State *L, lua_State *co) {
+	CoroutineKind *kind = FindKind(co);
+	if (kind != NULL) {
+		++kind->resumes;
+	}
+
+	if (m_mode != LLDEBUG_PROFILEMODE_TRACING) {
+		return;
+	}
+
+	Cost now = GetMonotonicTime();
+
+	// The functions of the coroutine are placed under the resume call,
+	// through the node of the kind.
+	ThreadStack &stack = m_threads[L];
+	stack.resumed = now;
+
+	int base = (stack.frames.empty() ? stack.base : stack.frames.back().node);
+	if (kind != NULL) {
+		base = GetChildNode(base, InternKindFunc(*kind));
+		++m_nodes[base].calls;
+	}
+
+	ThreadStack &costack = m_threads[co];
+	costack.base = base;
+	costack.sliceStart = now;
+	costack.nested = 0;
+	if (costack.suspended != 0) {
+		costack.paused += now - costack.suspended;
+		costack.suspended = 0;
+	}
+}
+
+void Profiler::EndCoroutine(lua_State *L, lua_State *co) {
+	if (m_mode != LLDEBUG_PROFILEMODE_TRACING) {
+		return;
+	}
+
+	Cost now = GetMonotonicTime();
+
+	// The time while suspended isn't counted by the yielded frames.
+	ThreadStackMap::iterator it = m_threads.find(co);
+	if (it != m_threads.end()) {
+		// The time of the slice is given to the kind,
+		// except the coroutines resumed by this one.
+		ThreadStack &costack = it->second;
+		CoroutineKind *kind = FindKind(co);
+		if (costack.sliceStart != 0) {
+			Cost slice = now - costack.sliceStart;
+			if (kind != NULL && kind->func >= 0
+				&& m_nodes[costack.base].func == kind->func) {
+				Node &node = m_nodes[costack.base];
+				node.total += slice;
+				if (node.parent == 0) {
+					m_nodes[0].total += slice;
+				}
+				kind->cost += (slice > costack.nested ? slice - costack.nested : 0);
+			}
+			m_threads[L].nested += slice;
+			costack.sliceStart = 0;
+		}
+
+		if (it->second.frames.empty()) {
+			m_threads.erase(it);
+		}
+		else {
+			it->second.suspended = now;
+		}
+	}
+
+	// The time in the coroutine is the child of the resume call.
+	ThreadStack &stack = m_threads[L];
+	if (!stack.frames.empty() && stack.resumed != 0) {
+		stack.frames.back().children += now - stack.resumed;
+	}
+	stack.resumed = 0;
+}
+
+void Profiler::PruneCoroutines(const std::set<lua_State *> &alive) {
+	ThreadStackMap::iterator it = m_threads.begin();
+	while (it != m_threads.end()) {
+		if (it->second.suspended != 0 && alive.count(it->first) == 0) {
+			m_threads.erase(it++);
+		}
+		else {
+			++it;
+		}
+	}
+
+	std::map<lua_State *, int>::iterator kind = m_threadKinds.begin();
+	while (kind != m_threadKinds.end()) {
+		if (alive.count(kind->first) == 0) {
+			m_threadKinds.erase(kind++);
+		}
+		else {
+			++kind;
+		}
+	}
+
+	// The next prune is done when the coroutines are doubled.
+	m_pruneSize = (m_threads.size() + m_threadKinds.size()) * 2;
+	if (m_pruneSize < LLDEBUG_PROFILE_PRUNESIZE) {
+		m_pruneSize = LLDEBUG_PROFILE_PRUNESIZE;
+	}
+}
+
+void Profiler::PopFrame(ThreadStack &stack, Cost now) {
+	Frame frame = stack.frames.back();
+	stack.frames.pop_back();
+
+	Cost total = now - frame.start - (stack.paused - frame.paused);
+	Node &node = m_nodes[frame.node];
+	node.total += total;
+	node.self += (total > frame.children ? total - frame.children : 0);
+
+	if (!stack.frames.empty()) {
+		stack.frames.back().children += total;
+	}
+	if (node.parent == 0) {
+		m_nodes[0].total += total;
+	}
+}
+
+/// Aggregate the costs of the call tree for each function.
+/** The total cost of the recursive call is counted only once.
+ */
+void Profiler::AggregateFuncs(int node, FuncStatList &stats) const {
+	const Node &n = m_nodes[node];
+	FuncStat *stat = NULL;
+
+	if (node != 0) {
+		stat = &stats[n.func];
+		stat->calls += n.calls;
+		stat->self += n.self;
+		if (stat->depth++ == 0) {
+			stat->total += n.total;
+		}
+	}
+
+	std::map<int, int>::const_iterator it;
+	for (it = n.children.begin(); it != n.children.end(); ++it) {
+		AggregateFuncs(it->second, stats);
+	}
+
+	if (stat != NULL) {
+		--stat->depth;
+	}
+}
+
+/// Aggregate the costs of the call tree for each caller and callee.
+void Profiler::AggregateCalls(CallStatMap &calls) const {
+	for (size_t i = 1; i < m_nodes.size(); ++i) {
+		const Node &n = m_nodes[i];
+		if (n.parent == 0) {
+			continue;
+		}
+
+		CallStat &stat = calls[std::make_pair(m_nodes[n.parent].func, n.func)];
+		stat.calls += n.calls;
+		stat.total += n.total;
+	}
+}
+
+/// Get the elapsed time of the profiling.
+Profiler::Cost Profiler::GetElapsedTime() const {
+	return (m_isRunning ? GetMonotonicTime() - m_startTime : m_elapsedTime);
+}
+
+/// Get the weight of the sample taken after 'count' instructions.
+/** The sampling mode counts the samples of the unscaled interval.
+ */
+Profiler::Cost Profiler::GetSampleWeight(int count) const {
+	if (m_mode == LLDEBUG_PROFILEMODE_INSTRUCTIONS) {
+		return (Cost)(count > 0 ? count : 1);
+	}
+
+	Cost weight = (Cost)(count / m_sampleInterval);
+	return (weight > 0 ? weight : 1);
+}
+
+/// Get the cost that is used as 100%.
+/** The running calls aren't counted by the tracing,
+ * so the elapsed time is used.
+ */
+double Profiler::GetTotalCost() const {
+	Cost total = (m_mode != LLDEBUG_PROFILEMODE_TRACING
+		? m_sampleCost
+		: GetElapsedTime());
+	return (total > 0 ? (double)total : 1.0);
+}
+
+void Profiler::DumpHeader(std::string &result) const {
+	if (m_mode == LLDEBUG_PROFILEMODE_SAMPLING) {
+		result += "# samples: ";
+		result += CostToString(m_sampleCount);
+		result += ", interval: ";
+		result += boost::lexical_cast<std::string>(m_sampleInterval);
+		result += " instructions\n";
+	}
+	else if (m_mode == LLDEBUG_PROFILEMODE_INSTRUCTIONS) {
+		result += "# instructions: ";
+		result += CostToString(m_sampleCost);
+		result += ", interval: ";
+		result += boost::lexical_cast<std::string>(m_sampleInterval);
+		result += " instructions\n";
+	}
+	else {
+		result += "# traced: ";
+		result += CostToString(m_nodes[0].total);
+		result += " usec, elapsed: ";
+		result += CostToString(GetElapsedTime());
+		result += " usec\n";
+		if (m_isRunning) {
+			result += "# the running calls aren't counted\n";
+		}
+	}
+
+	if (m_mode != LLDEBUG_PROFILEMODE_TRACING && m_maxScale > 1) {
+		result += "# the interval was scaled up to ";
+		result += boost::lexical_cast<std::string>(m_maxScale);
+		result += " times by the governor, the samples are weighted\n";
+	}
+}
+
+void Profiler::DumpCallTree(std::string &result, int node, int depth) const {
+	const Node &n = m_nodes[node];
+
+	if (node != 0) {
+		const FuncInfo &info = m_funcs[n.func];
+		double total = GetTotalCost();
+		char buffer[64];
+
+		snprintf(buffer, sizeof(buffer), "%6.2f%% %6.2f%% %10s  ",
+			100.0 * n.total / total,
+			100.0 * n.self / total,
+			CostToString(m_mode != LLDEBUG_PROFILEMODE_TRACING
+				? n.total : n.calls).c_str());
+		result += buffer;
+		result.append(depth * 2, ' ');
+		result += info.name;
+		result += "  (";
+		result += info.source;
+		result += ":";
+		result += boost::lexical_cast<std::string>(info.line);
+		result += ")\n";
+	}
+
+	// The children are sorted by the total cost.
+	std::vector<std::pair<Cost, int> > children;
+	std::map<int, int>::const_iterator it;
+	for (it = n.children.begin(); it != n.children.end(); ++it) {
+		children.push_back(std::make_pair(m_nodes[it->second].total, it->second));
+	}
+	std::sort(children.begin(), children.end(),
+		std::greater<std::pair<Cost, int> >());
+
+	for (size_t i = 0; i < children.size(); ++i) {
+		DumpCallTree(result, children[i].second, (node != 0 ? depth + 1 : 0));
+	}
+}
+
+void Profiler::DumpFunctions(std::string &result) const {
+	FuncStatList stats(m_funcs.size());
+	AggregateFuncs(0, stats);
+
+	// The functions are sorted by the self cost.
+	std::vector<std::pair<Cost, int> > order;
+	for (size_t i = 0; i < stats.size(); ++i) {
+		order.push_back(std::make_pair(stats[i].self, (int)i));
+	}
+	std::sort(order.begin(), order.end(),
+		std::greater<std::pair<Cost, int> >());
+
+	double total = GetTotalCost();
+	Cost nativeSelf = 0;
+	Cost nativeCalls = 0;
+	for (size_t i = 0; i < order.size(); ++i) {
+		const FuncStat &stat = stats[order[i].second];
+		const FuncInfo &info = m_funcs[order[i].second];
+		char buffer[128];
+
+		if (stat.total == 0 && stat.calls == 0) {
+			continue;
+		}
+
+		if (info.isNative) {
+			nativeSelf += stat.self;
+			nativeCalls += stat.calls;
+		}
+
+		snprintf(buffer, sizeof(buffer), "%6.2f%% %6.2f%% %12s %12s %10s  ",
+			100.0 * stat.self / total,
+			100.0 * stat.total / total,
+			CostToString(stat.self).c_str(),
+			CostToString(stat.total).c_str(),
+			CostToString(stat.calls).c_str());
+		result += buffer;
+		result += info.name;
+		result += "  (";
+		result += info.source;
+		result += ":";
+		result += boost::lexical_cast<std::string>(info.line);
+		result += ")\n";
+	}
+
+	// The self cost of the C functions is the time in the bindings,
+	// the samples can't be in them because the count hook is for lua.
+	if (m_mode == LLDEBUG_PROFILEMODE_TRACING) {
+		char buffer[128];
+
+		snprintf(buffer, sizeof(buffer), "%6.2f%% %7s %12s %12s %10s  ",
+			100.0 * nativeSelf / total, "",
+			CostToString(nativeSelf).c_str(), "",
+			CostToString(nativeCalls).c_str());
+		result += "\n";
+		result += buffer;
+		result += "(all the C functions)\n";
+	}
+}
+
+/// Dump the cost of each kind of the coroutines.
+/** The average slice is the cost for each resume.
+ */
+void Profiler::DumpCoroutines(std::string &result) const {
+	std::vector<std::pair<Cost, int> > order;
+	for (size_t i = 0; i < m_kinds.size(); ++i) {
+		if (m_kinds[i].resumes > 0 || m_kinds[i].cost > 0) {
+			order.push_back(std::make_pair(m_kinds[i].cost, (int)i));
+		}
+	}
+	if (order.empty()) {
+		return;
+	}
+	std::sort(order.begin(), order.end(),
+		std::greater<std::pair<Cost, int> >());
+
+	result += "\n";
+	result += "#   cost         cost    resumes  avg slice  coroutine created at\n";
+
+	double total = GetTotalCost();
+	for (size_t i = 0; i < order.size(); ++i) {
+		const CoroutineKind &kind = m_kinds[order[i].second];
+		char buffer[128];
+
+		snprintf(buffer, sizeof(buffer), "%6.2f%% %12s %10s %10s  ",
+			100.0 * kind.cost / total,
+			CostToString(kind.cost).c_str(),
+			CostToString(kind.resumes).c_str(),
+			CostToString(kind.resumes > 0 ? kind.cost / kind.resumes : 0).c_str());
+		result += buffer;
+		result += kind.source;
+		result += ":";
+		result += boost::lexical_cast<std::string>(kind.line);
+		result += "\n";
+	}
+}
+
+/// Dump the profile as the callgrind format.
+/** The functions are compressed as 'fn=(id)',
+ * because the C functions may have the same names.
+ */
+void Profiler::DumpCallgrind(std::string &result) const {
+	FuncStatList stats(m_funcs.size());
+	CallStatMap calls;
+	AggregateFuncs(0, stats);
+	AggregateCalls(calls);
+
+	result += "version: 1\n";
+	result += "creator: lldebug\n";
+	result += "positions: line\n";
+	result += (m_mode == LLDEBUG_PROFILEMODE_SAMPLING ? "events: Samples\n"
+		: m_mode == LLDEBUG_PROFILEMODE_INSTRUCTIONS ? "events: Ir\n"
+		: "events: Microseconds\n");
+	result += "\n";
+
+	std::vector<bool> isNamed(m_funcs.size(), false);
+	CallStatMap::const_iterator callIt = calls.begin();
+	for (size_t i = 0; i < stats.size(); ++i) {
+		const FuncInfo &info = m_funcs[i];
+		std::string id = boost::lexical_cast<std::string>(i);
+		int line = (info.line > 0 ? info.line : 0);
+
+		if (stats[i].total == 0 && stats[i].calls == 0) {
+			continue;
+		}
+
+		result += "fl=" + info.source + "\n";
+		result += "fn=(" + id + ")";
+		if (!isNamed[i]) {
+			result += " " + info.name;
+			isNamed[i] = true;
+		}
+		result += "\n";
+		result += boost::lexical_cast<std::string>(line);
+		result += " " + CostToString(stats[i].self) + "\n";
+
+		// The calls are sorted by the caller.
+		for (; callIt != calls.end() && callIt->first.first == (int)i; ++callIt) {
+			int callee = callIt->first.second;
+			const FuncInfo &calleeInfo = m_funcs[callee];
+			std::string calleeId = boost::lexical_cast<std::string>(callee);
+			Cost count = (callIt->second.calls > 0 ? callIt->second.calls : 1);
+
+			result += "cfl=" + calleeInfo.source + "\n";
+			result += "cfn=(" + calleeId + ")";
+			if (!isNamed[callee]) {
+				result += " " + calleeInfo.name;
+				isNamed[callee] = true;
+			}
+			result += "\n";
+			result += "calls=" + CostToString(count) + " ";
+			result += boost::lexical_cast<std::string>(
+				calleeInfo.line > 0 ? calleeInfo.line : 0) + "\n";
+			result += boost::lexical_cast<std::string>(line);
+			result += " " + CostToString(callIt->second.total) + "\n";
+		}
+		result += "\n";
+	}
+}
+
+/// Dump the stacks of the call tree as the collapsed format.
+/** Each line is "outer;inner cost" for the node that has the self cost,
+ * the same stacks were already merged to one node while profiling.
+ */
+void Profiler::DumpFolded(std::string &result, int node, std::string &stack,
+						  const string_array &names) const {
+	const Node &n = m_nodes[node];
+	size_t length = stack.length();
+
+	if (node != 0) {
+		if (length > 0) {
+			stack += ';';
+		}
+		stack += names[n.func];
+
+		if (n.self > 0) {
+			result += stack;
+			result += ' ';
+			result += CostToString(n.self);
+			result += '\n';
+		}
+	}
+
+	std::map<int, int>::const_iterator it;
+	for (it = n.children.begin(); it != n.children.end(); ++it) {
+		DumpFolded(result, it->second, stack, names);
+	}
+
+	stack.resize(length);
+}
+
+std::string Profiler::Dump(lldebug_ProfileFormat format) const {
+	std::string result;
+
+	switch (format) {
+	case LLDEBUG_PROFILEFORMAT_CALLTREE:
+		DumpHeader(result);
+		result += (m_mode == LLDEBUG_PROFILEMODE_SAMPLING
+			? "#  total    self     samples  function\n"
+			: m_mode == LLDEBUG_PROFILEMODE_INSTRUCTIONS
+			? "#  total    self      instrs  function\n"
+			: "#  total    self       calls  function\n");
+		DumpCallTree(result, 0, 0);
+		break;
+	case LLDEBUG_PROFILEFORMAT_FUNCTIONS:
+		DumpHeader(result);
+		result += "#   self   total         self        total      calls  function\n";
+		DumpFunctions(result);
+		DumpCoroutines(result);
+		break;
+	case LLDEBUG_PROFILEFORMAT_CALLGRIND:
+		DumpCallgrind(result);
+		break;
+	case LLDEBUG_PROFILEFORMAT_FOLDED: {
+		// The frame names are made only once for each function,
+		// ';' is the separator of the frames.
+		string_array names;
+		for (size_t i = 0; i < m_funcs.size(); ++i) {
+			const FuncInfo &info = m_funcs[i];
+			std::string name = info.name + " (" + info.source + ":"
+				+ boost::lexical_cast<std::string>(info.line) + ")";
+			std::replace(name.begin(), name.end(), ';', ':');
+			std::replace(name.begin(), name.end(), '\n', ' ');
+			names.push_back(name);
+		}
+
+		std::string stack;
+		DumpFolded(result, 0, stack, names);
+		}
+		break;
+	}
+
+	return result;
+}
+
+} // end of namespace context
+} // end of namespace lldebug
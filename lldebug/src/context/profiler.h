@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __LLDEBUG_PROFILER_H__
+#define __LLDEBUG_PROFILER_H__
+
+#include "llprofile.h"
+
+namespace lldebug {
+namespace context {
+
+/**
+ * @brief Profiler of the lua functions.
+ *
+ * The sampling mode samples the call stack by the count hook,
+ * and the tracing mode measures the time of each call by the call and
+ * return hooks. The instructions mode is the sampling whose samples are
+ * weighted by the interval, so the cost doesn't depend on the machine.
+ * All of them are aggregated into the same call tree,
+ * nothing is sent until the profile is dumped.
+ * The coroutines are grouped by the place where they were created,
+ * and each group is placed above the functions of the coroutines.
+ * It's used under the lock of the Context.
+ */
+class Profiler {
+public:
+	/// The cost of the node (samples, microseconds or instructions).
+	typedef boost::uint64_t Cost;
+
+	explicit Profiler();
+	~Profiler();
+
+	/// Is the profiler running ?
+	bool IsRunning() const {
+		return m_isRunning;
+	}
+
+	/// Is the count hook used ? (sampling or instructions)
+	bool IsSampling() const {
+		return (m_isRunning && m_mode != LLDEBUG_PROFILEMODE_TRACING);
+	}
+
+	/// Is the tracing running ?
+	bool IsTracing() const {
+		return (m_isRunning && m_mode == LLDEBUG_PROFILEMODE_TRACING);
+	}
+
+	/// Get the instructions between the samples.
+	/** It's scaled by the governor, and clamped to INT_MAX.
+	 */
+	int GetSampleInterval() const;
+
+	/// Scale the interval of the samples.
+	/** The samples are weighted by the instructions since the last one,
+	 * so the costs are comparable with the ones before it.
+	 */
+	void SetIntervalScale(int scale);
+
+	/// Clear the old profile and start the profiler.
+	/** 'interval' isn't used by the tracing mode.
+	 */
+	void Start(lldebug_ProfileMode mode, int interval);
+
+	/// Stop the profiler, the profile is kept until the next start.
+	void Stop();
+
+	/// Clear the profile.
+	void Clear();
+
+	/// Take a sample of the call stack of 'L'.
+	/** 'count' is the hook count of 'L', the instructions since the last
+	 * sample. The hook of 'L' may still have the count of the old scale.
+	 */
+	void Sample(lua_State *L, int count);
+
+	/// The function of 'ar' was called (tracing).
+	void OnCall(lua_State *L, lua_Debug *ar);
+
+	/// The function of 'ar' returned (tracing).
+	void OnReturn(lua_State *L, lua_Debug *ar);
+
+	/// The function replaced by the tail call returned (tracing).
+	void OnTailReturn(lua_State *L);
+
+	/// The coroutine 'co' was created by the function running in 'L'.
+	/** It's recorded even if the profiler isn't running.
+	 */
+	void OnCreateCoroutine(lua_State *L, lua_State *co);
+
+	/// The coroutine 'co' is resumed from 'L'.
+	void BeginCoroutine(lua_State *L, lua_State *co);
+
+	/// The coroutine 'co' yielded or ended.
+	void EndCoroutine(lua_State *L, lua_State *co);
+
+	/// Are there many coroutines that may have been collected ?
+	bool IsPruneNeeded() const {
+		return (m_threads.size() + m_threadKinds.size() > m_pruneSize);
+	}
+
+	/// Forget the coroutines that aren't in 'alive'.
+	/** The stacks of the running or not yielded threads are kept.
+	 */
+	void PruneCoroutines(const std::set<lua_State *> &alive);
+
+	/// Make the string of the profile.
+	std::string Dump(lldebug_ProfileFormat format) const;
+
+	/// Get the monotonic time in microseconds.
+	static Cost GetMonotonicTime();
+
+	/// Get the samples of each line of the source (sampling).
+	/** The index is the line number, NULL if the source wasn't sampled.
+	 */
+	const std::vector<int> *GetLineSamples(const std::string &key) const;
+
+private:
+	/// Infomation of the profiled function.
+	struct FuncInfo {
+		std::string name;
+		std::string source;
+		int line;
+		bool isNative; ///< C function
+	};
+
+	/// Node of the call tree, 0 is the root.
+	struct Node {
+		explicit Node(int func_ = -1, int parent_ = -1)
+			: func(func_), parent(parent_), calls(0), self(0), total(0) {
+		}
+		int func;
+		int parent;
+		Cost calls;
+		Cost self;
+		Cost total;
+		std::map<int, int> children; ///< func -> node
+	};
+
+	/// The running call of the shadow stack.
+	struct Frame {
+		int node;
+		Cost start;
+		Cost children; ///< total cost of the called functions
+		Cost paused; ///< 'ThreadStack::paused' at the call
+	};
+
+	/// The shadow stack of each lua_State object.
+	struct ThreadStack {
+		explicit ThreadStack()
+			: base(0), paused(0), suspended(0), resumed(0)
+			, sliceStart(0), nested(0) {
+		}
+		std::vector<Frame> frames;
+		int base; ///< the node that resumed this coroutine
+		Cost paused; ///< total time while this coroutine is suspended
+		Cost suspended; ///< the time of the last yield, or 0
+		Cost resumed; ///< the time that this resumed the other coroutine
+		Cost sliceStart; ///< the time of the last resume
+		Cost nested; ///< time of the other coroutines in this slice
+	};
+
+	/// The coroutines created at the same place.
+	struct CoroutineKind {
+		explicit CoroutineKind()
+			: line(0), func(-1), resumes(0), cost(0) {
+		}
+		std::string source;
+		int line;
+		int func; ///< the function of the call tree, -1 if not used yet
+		Cost resumes;
+		Cost cost; ///< samples or time, the nested coroutines excluded
+	};
+
+	/// The samples of each line of the source.
+	struct LineSamples {
+		std::string key;
+		std::vector<int> lines;
+	};
+
+	/// The aggregated cost of each function.
+	struct FuncStat {
+		explicit FuncStat()
+			: calls(0), self(0), total(0), depth(0) {
+		}
+		Cost calls;
+		Cost self;
+		Cost total;
+		int depth; ///< count of the recursive calls while aggregating
+	};
+	typedef std::vector<FuncStat> FuncStatList;
+
+	/// The aggregated cost of each caller and callee pair.
+	struct CallStat {
+		explicit CallStat()
+			: calls(0), total(0) {
+		}
+		Cost calls;
+		Cost total;
+	};
+	typedef std::map<std::pair<int, int>, CallStat> CallStatMap;
+
+	int InternFunc(lua_State *L, lua_Debug *ar);
+	LineSamples &FindLineSamples(const char *source);
+	CoroutineKind *FindKind(lua_State *co);
+	int InternKindFunc(CoroutineKind &kind);
+	int GetChildNode(int node, int func);
+	void PopFrame(ThreadStack &stack, Cost now);
+	void AggregateFuncs(int node, FuncStatList &stats) const;
+	void AggregateCalls(CallStatMap &calls) const;
+	Cost GetSampleWeight(int count) const;
+	Cost GetElapsedTime() const;
+	double GetTotalCost() const;
+	void DumpHeader(std::string &result) const;
+	void DumpCallTree(std::string &result, int node, int depth) const;
+	void DumpFunctions(std::string &result) const;
+	void DumpCoroutines(std::string &result) const;
+	void DumpCallgrind(std::string &result) const;
+	void DumpFolded(std::string &result, int node, std::string &stack,
+					const string_array &names) const;
+
+private:
+	typedef std::map<std::pair<const void *, int>, int> FuncIdMap;
+	FuncIdMap m_funcIds;
+	std::vector<FuncInfo> m_funcs;
+	std::vector<Node> m_nodes;
+	std::vector<int> m_stack; ///< reused by each sample
+	Cost m_sampleCount;
+	Cost m_sampleCost; ///< the sum of the weights of the samples
+	int m_intervalScale;
+	int m_maxScale; ///< the max scale while profiling
+	std::vector<LineSamples> m_lineSamples;
+	std::map<const char *, int> m_lineSampleIds; ///< the interned source pointer -> samples
+	std::map<std::string, int> m_lineSampleNames; ///< source key -> samples
+	const char *m_lastLineSource;
+	int m_lastLineSampleId;
+
+	typedef std::map<lua_State *, ThreadStack> ThreadStackMap;
+	ThreadStackMap m_threads;
+
+	/// The kinds are kept by Clear, because the coroutines live longer.
+	std::vector<CoroutineKind> m_kinds;
+	std::map<std::string, int> m_kindIds; ///< "source:line" -> kind
+	std::map<lua_State *, int> m_threadKinds; ///< coroutine -> kind
+	size_t m_pruneSize; ///< the coroutines are pruned above this
+	Cost m_startTime;
+	Cost m_elapsedTime;
+
+	bool m_isRunning;
+	lldebug_ProfileMode m_mode;
+	int m_sampleInterval;
+};
+
+} // end of namespace context
+} // end of namespace lldebug
+
+#endif
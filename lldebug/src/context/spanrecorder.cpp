@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "precomp.h"
+#include "context/spanrecorder.h"
+#include "context/luautils.h"
+
+/// The max count of the spans not ended yet for each lua_State.
+#ifndef LLDEBUG_SPAN_MAXOPEN
+#define LLDEBUG_SPAN_MAXOPEN 1024
+#endif
+
+/// The count of the threads that are kept without pruning.
+#ifndef LLDEBUG_SPAN_PRUNESIZE
+#define LLDEBUG_SPAN_PRUNESIZE 64
+#endif
+
+namespace lldebug {
+namespace context {
+
+/// Convert the cost to the string.
+static std::string CostToString(SpanRecorder::Cost cost) {
+	return boost::lexical_cast<std::string>(cost);
+}
+
+/// Escape the string for the json.
+static std::string EscapeJson(const std::string &str) {
+	std::string result;
+
+	for (std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+		unsigned char c = (unsigned char)*it;
+
+		if (c == '"' || c == '\\') {
+			result += '\\';
+			result += (char)c;
+		}
+		else if (c < 0x20) {
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+			result += buffer;
+		}
+		else {
+			result += (char)c;
+		}
+	}
+
+	return result;
+}
+
+SpanRecorder::SpanRecorder()
+	: m_lastTid(0), m_pruneSize(LLDEBUG_SPAN_PRUNESIZE)
+	, m_startTime(0), m_isRunning(false), m_autoSpans(false)
+	, m_capacity(LLDEBUG_DEFAULT_SPANCAPACITY) {
+}
+
+SpanRecorder::~SpanRecorder() {
+}
+
+void SpanRecorder::Start(bool autoSpans, int capacity) {
+	Clear();
+
+	m_autoSpans = autoSpans;
+	m_capacity = (capacity > 0 ? capacity : LLDEBUG_DEFAULT_SPANCAPACITY);
+	m_startTime = Profiler::GetMonotonicTime();
+	m_isRunning = true;
+}
+
+void SpanRecorder::Stop() {
+	m_isRunning = false;
+}
+
+void SpanRecorder::Clear() {
+	m_nameIds.clear();
+	m_names.clear();
+	m_funcNames.clear();
+	m_threads.clear();
+	m_lastTid = 0;
+	m_pruneSize = LLDEBUG_SPAN_PRUNESIZE;
+}
+
+void SpanRecorder::IgnoreFunc(lua_CFunction f) {
+	m_ignoredFuncs.insert((const void *)f);
+}
+
+void SpanRecorder::ForgetThread(lua_State *L) {
+	m_threads.erase(L);
+}
+
+void SpanRecorder::PruneThreads(const std::set<lua_State *> &alive) {
+	ThreadSpansMap::iterator it = m_threads.begin();
+	while (it != m_threads.end()) {
+		if (alive.count(it->first) == 0) {
+			m_threads.erase(it++);
+		}
+		else {
+			++it;
+		}
+	}
+
+	// The next prune is done when the threads are doubled.
+	m_pruneSize = m_threads.size() * 2;
+	if (m_pruneSize < LLDEBUG_SPAN_PRUNESIZE) {
+		m_pruneSize = LLDEBUG_SPAN_PRUNESIZE;
+	}
+}
+
+SpanRecorder::ThreadSpans &SpanRecorder::GetThread(lua_State *L) {
+	ThreadSpansMap::iterator it = m_threads.find(L);
+	if (it != m_threads.end()) {
+		return it->second;
+	}
+
+	// The tid is the order that the lua_State was found.
+	ThreadSpans thread(++m_lastTid);
+	return m_threads.insert(std::make_pair(L, thread)).first->second;
+}
+
+int SpanRecorder::InternName(const std::string &name) {
+	std::map<std::string, int>::iterator it = m_nameIds.find(name);
+	if (it != m_nameIds.end()) {
+		return it->second;
+	}
+
+	int id = (int)m_names.size();
+	m_names.push_back(name);
+	m_nameIds.insert(std::make_pair(name, id));
+	return id;
+}
+
+/// Get the name of the function, it's made only once for each function.
+/** 'ar' must have the "S" infomation.
+ */
+int SpanRecorder::InternFunc(lua_State *L, lua_Debug *ar) {
+	lua_CFunction cfunc = NULL;
+	const void *key;
+	int line;
+
+	if (*ar->what == 'C') {
+		lua_getinfo(L, "f", ar);
+		cfunc = lua_tocfunction(L, -1);
+		lua_pop(L, 1);
+		key = (const void *)cfunc;
+		line = -1;
+	}
+	else if (*ar->what == 't') {
+		key = NULL; // tail call
+		line = -1;
+	}
+	else {
+		key = ar->source;
+		line = ar->linedefined;
+	}
+
+	FuncNameMap::key_type funcKey(key, line);
+	FuncNameMap::iterator it = m_funcNames.find(funcKey);
+	if (it != m_funcNames.end()) {
+		return it->second;
+	}
+
+	int id = -1;
+	if (cfunc == NULL || m_ignoredFuncs.find(key) == m_ignoredFuncs.end()) {
+		std::string name;
+		if (cfunc != NULL) {
+			name = llutil_findcfuncname(L, cfunc);
+		}
+		if (name.empty()) {
+			lua_getinfo(L, "n", ar);
+			name = llutil_makefuncname(ar);
+		}
+		if (*ar->what != 'C' && *ar->what != 't') {
+			name += " (" + std::string(ar->short_src) + ":"
+				+ boost::lexical_cast<std::string>(ar->linedefined) + ")";
+		}
+		id = InternName(name);
+	}
+
+	m_funcNames.insert(std::make_pair(funcKey, id));
+	return id;
+}
+
+/// Push the span not ended yet.
+/** The oldest one is dropped if there are too many,
+ * e.g. the user's spans that are never ended.
+ */
+void SpanRecorder::OpenSpan(ThreadSpans &thread, const Span &span) {
+	if (thread.open.size() >= LLDEBUG_SPAN_MAXOPEN) {
+		thread.open.erase(thread.open.begin());
+		++thread.dropped;
+	}
+
+	thread.open.push_back(span);
+}
+
+/// Move the open span to the ring buffer.
+void SpanRecorder::CloseSpan(ThreadSpans &thread, size_t i, Cost now) {
+	Span span = thread.open[i];
+	thread.open.erase(thread.open.begin() + i);
+	if (span.name < 0) {
+		return;
+	}
+
+	span.duration = now - span.start;
+	if (thread.ring.size() < m_capacity) {
+		thread.ring.push_back(span);
+	}
+	else {
+		thread.ring[thread.next] = span;
+		thread.next = (thread.next + 1) % m_capacity;
+		++thread.dropped;
+	}
+}
+
+void SpanRecorder::BeginSpan(lua_State *L, const std::string &name) {
+	Span span;
+	span.name = InternName(name);
+	span.start = Profiler::GetMonotonicTime();
+	span.duration = 0;
+	span.isAuto = false;
+	OpenSpan(GetThread(L), span);
+}
+
+int SpanRecorder::EndSpan(lua_State *L) {
+	Cost now = Profiler::GetMonotonicTime();
+	ThreadSpans &thread = GetThread(L);
+
+	// The automatic spans begun after it are left.
+	for (size_t i = thread.open.size(); i > 0; --i) {
+		if (!thread.open[i - 1].isAuto) {
+			CloseSpan(thread, i - 1, now);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void SpanRecorder::OnCall(lua_State *L, lua_Debug *ar) {
+	Span span;
+	span.start = Profiler::GetMonotonicTime();
+	lua_getinfo(L, "S", ar);
+	span.name = InternFunc(L, ar);
+	span.duration = 0;
+	span.isAuto = true;
+	OpenSpan(GetThread(L), span);
+}
+
+void SpanRecorder::OnReturn(lua_State *L, lua_Debug *ar) {
+	Cost now = Profiler::GetMonotonicTime();
+	ThreadSpansMap::iterator it = m_threads.find(L);
+	if (it == m_threads.end()) {
+		return;
+	}
+
+	// The calls unwound by the error didn't get their return events,
+	// so they are closed together with the returned function.
+	// The spans begun by the user are left.
+	ThreadSpans &thread = it->second;
+	lua_getinfo(L, "S", ar);
+	int name = InternFunc(L, ar);
+	size_t size = thread.open.size();
+	while (size > 0
+		&& !(thread.open[size - 1].isAuto && thread.open[size - 1].name == name)) {
+		--size;
+	}
+	if (size == 0) {
+		return;
+	}
+
+	for (size_t i = thread.open.size(); i >= size; --i) {
+		if (thread.open[i - 1].isAuto) {
+			CloseSpan(thread, i - 1, now);
+		}
+	}
+}
+
+void SpanRecorder::OnTailReturn(lua_State *L) {
+	Cost now = Profiler::GetMonotonicTime();
+	ThreadSpansMap::iterator it = m_threads.find(L);
+	if (it == m_threads.end()) {
+		return;
+	}
+
+	ThreadSpans &thread = it->second;
+	for (size_t i = thread.open.size(); i > 0; --i) {
+		if (thread.open[i - 1].isAuto) {
+			CloseSpan(thread, i - 1, now);
+			return;
+		}
+	}
+}
+
+void SpanRecorder::DumpEvent(std::string &result, const ThreadSpans &thread,
+							 const Span &span, bool isEnded) const {
+	if (span.name < 0) {
+		return;
+	}
+
+	result += ",\n{\"name\":\"";
+	result += EscapeJson(m_names[span.name]);
+	result += (isEnded ? "\",\"ph\":\"X\",\"ts\":" : "\",\"ph\":\"B\",\"ts\":");
+	result += CostToString(span.start - m_startTime);
+	if (isEnded) {
+		result += ",\"dur\":";
+		result += CostToString(span.duration);
+	}
+	result += ",\"pid\":1,\"tid\":";
+	result += boost::lexical_cast<std::string>(thread.tid);
+	result += "}";
+}
+
+/// Make the string of the chrome trace event format.
+/** The thread names are written first as the metadata events,
+ * and each name has the count of the dropped spans if any.
+ */
+std::string SpanRecorder::DumpChromeTrace() const {
+	std::string result;
+
+	result += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	result += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,";
+	result += "\"args\":{\"name\":\"lua\"}}";
+
+	ThreadSpansMap::const_iterator it;
+	for (it = m_threads.begin(); it != m_threads.end(); ++it) {
+		const ThreadSpans &thread = it->second;
+		std::string tid = boost::lexical_cast<std::string>(thread.tid);
+
+		result += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+		result += tid;
+		result += ",\"args\":{\"name\":\"lua_State " + tid;
+		if (thread.dropped > 0) {
+			result += " (" + CostToString(thread.dropped) + " spans dropped)";
+		}
+		result += "\"}}";
+	}
+
+	for (it = m_threads.begin(); it != m_threads.end(); ++it) {
+		const ThreadSpans &thread = it->second;
+
+		for (size_t i = 0; i < thread.ring.size(); ++i) {
+			DumpEvent(result, thread, thread.ring[i], true);
+		}
+		for (size_t i = 0; i < thread.open.size(); ++i) {
+			DumpEvent(result, thread, thread.open[i], false);
+		}
+	}
+
+	result += "\n]}\n";
+	return result;
+}
+
+} // end of namespace context
+} // end of namespace lldebug
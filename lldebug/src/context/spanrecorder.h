@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2005-2008  cielacanth <cielacanth AT s60.xrea.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __LLDEBUG_SPANRECORDER_H__
+#define __LLDEBUG_SPANRECORDER_H__
+
+#include "context/profiler.h"
+
+namespace lldebug {
+namespace context {
+
+/**
+ * @brief Recorder of the trace spans.
+ *
+ * The spans are begun and ended by the lua functions or the C API,
+ * and the calls of the functions are the spans too if 'autoSpans'.
+ * The ended spans are kept in the ring buffer of each lua_State object,
+ * so the oldest ones are dropped when it's full.
+ * It's used under the lock of the Context.
+ */
+class SpanRecorder {
+public:
+	typedef Profiler::Cost Cost;
+
+	explicit SpanRecorder();
+	~SpanRecorder();
+
+	/// Is the recorder running ?
+	bool IsRunning() const {
+		return m_isRunning;
+	}
+
+	/// Are the calls recorded as the spans ?
+	bool IsAutoSpans() const {
+		return (m_isRunning && m_autoSpans);
+	}
+
+	/// Clear the old spans and start recording.
+	/** 'capacity' is the count of the spans kept for each lua_State.
+	 */
+	void Start(bool autoSpans, int capacity);
+
+	/// Stop recording, the spans are kept until the next start.
+	void Stop();
+
+	/// Clear the spans.
+	void Clear();
+
+	/// The C function isn't recorded by the automatic spans.
+	void IgnoreFunc(lua_CFunction f);
+
+	/// Forget the spans of 'L', whose address may be reused.
+	void ForgetThread(lua_State *L);
+
+	/// Are there many threads that may have been collected ?
+	bool IsPruneNeeded() const {
+		return (m_threads.size() > m_pruneSize);
+	}
+
+	/// Forget the threads that aren't in 'alive'.
+	void PruneThreads(const std::set<lua_State *> &alive);
+
+	/// Begin the span of 'L'.
+	void BeginSpan(lua_State *L, const std::string &name);
+
+	/// End the last span begun by BeginSpan.
+	/** It returns -1 if there is no span to end.
+	 */
+	int EndSpan(lua_State *L);
+
+	/// The function of 'ar' was called (automatic spans).
+	void OnCall(lua_State *L, lua_Debug *ar);
+
+	/// The function of 'ar' returned (automatic spans).
+	void OnReturn(lua_State *L, lua_Debug *ar);
+
+	/// The function replaced by the tail call returned (automatic spans).
+	void OnTailReturn(lua_State *L);
+
+	/// Make the string of the chrome trace event format.
+	/** The spans not ended yet are written as the begin events.
+	 */
+	std::string DumpChromeTrace() const;
+
+private:
+	/// The span of the name, 'name' is -1 for the ignored function.
+	struct Span {
+		int name;
+		Cost start;
+		Cost duration;
+		bool isAuto; ///< begun by the call
+	};
+
+	/// The spans of each lua_State object.
+	struct ThreadSpans {
+		explicit ThreadSpans(int tid_ = 0)
+			: tid(tid_), next(0), dropped(0) {
+		}
+		int tid;
+		std::vector<Span> ring; ///< the ended spans
+		size_t next; ///< the next position when the ring is full
+		Cost dropped;
+		std::vector<Span> open; ///< the spans not ended yet
+	};
+
+	ThreadSpans &GetThread(lua_State *L);
+	void OpenSpan(ThreadSpans &thread, const Span &span);
+	int InternName(const std::string &name);
+	int InternFunc(lua_State *L, lua_Debug *ar);
+	void CloseSpan(ThreadSpans &thread, size_t i, Cost now);
+	void DumpEvent(std::string &result, const ThreadSpans &thread,
+				   const Span &span, bool isEnded) const;
+
+private:
+	std::map<std::string, int> m_nameIds;
+	string_array m_names;
+	typedef std::map<std::pair<const void *, int>, int> FuncNameMap;
+	FuncNameMap m_funcNames; ///< (function, linedefined) -> name
+	std::set<const void *> m_ignoredFuncs;
+
+	typedef std::map<lua_State *, ThreadSpans> ThreadSpansMap;
+	ThreadSpansMap m_threads;
+	int m_lastTid;
+	size_t m_pruneSize; ///< the threads are pruned above this
+	Cost m_startTime;
+
+	bool m_isRunning;
+	bool m_autoSpans;
+	size_t m_capacity;
+};
+
+} // end of namespace context
+} // end of namespace lldebug
+
+#endif
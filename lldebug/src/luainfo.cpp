@@ -26,6 +26,7 @@
 
 #include "precomp.h"
 #include "luainfo.h"
+#include <algorithm>
 
 #ifdef LLDEBUG_CONTEXT
 #include "context/luautils.h"
@@ -75,29 +76,61 @@ LuaStackFrame::~LuaStackFrame() {
 }
 
 
+/*-----------------------------------------------------------------*/
+LuaVarRef::LuaVarRef(const LuaHandle &lua, int tableIdx, int generation)
+	: m_lua(lua), m_tableIdx(tableIdx), m_generation(generation)
+	, m_valueIdx(-1) {
+}
+
+LuaVarRef::~LuaVarRef() {
+}
+
+#ifdef LLDEBUG_CONTEXT
+int LuaVarRef::PushTable(lua_State *L) const {
+	if (!IsOk()) {
+		return -1;
+	}
+
+	return context::llutil_pushhandle(L, m_tableIdx, m_generation);
+}
+#endif
+
+
 /*-----------------------------------------------------------------*/
 LuaVar::LuaVar()
-	: m_valueType(-1), m_tableIdx(-1), m_hasFields(false) {
+	: m_valueLength(0), m_valueType(-1), m_hasFields(false) {
 }
 
 LuaVar::~LuaVar() {
 }
 
 #ifdef LLDEBUG_CONTEXT
-LuaVar::LuaVar(const LuaHandle &lua, const std::string &name, int valueIdx)
-	: m_lua(lua), m_name(name) {
+LuaVar::LuaVar(const LuaHandle &lua, const std::string &name, int valueIdx,
+			   bool isNativeFormatter, int previewLength)
+	: m_name(name) {
 
 	lua_State *L = lua.GetState();
-	m_value = context::llutil_tostring_for_varvalue(L, valueIdx);
+	m_value = context::llutil_tostring_for_varslice(
+		L, valueIdx, isNativeFormatter, 0, previewLength, m_valueLength);
 	m_valueType = lua_type(L, valueIdx);
-	m_tableIdx = RegisterTable(L, valueIdx);
 	m_hasFields = CheckHasFields(L, valueIdx);
+
+	// Only the vars that can be expanded need the handles.
+	// Strings can't be collected from the weak tables,
+	// so they would stay in the handle table forever.
+	m_ref = (m_hasFields ? RegisterTable(L, valueIdx) : LuaVarRef(lua));
+
+	// Keep the value so that the frame can fetch the rest of it.
+	if (IsTruncated()) {
+		m_ref.SetValueIdx(context::llutil_keepvalue(L, valueIdx));
+	}
 }
 
 LuaVar::LuaVar(const LuaHandle &lua, const std::string &name,
 			   const std::string &error)
-	: m_lua(lua), m_name(name), m_value(error), m_valueType(LUA_TNONE)
-	, m_tableIdx(-1), m_hasFields(false) {
+	: m_ref(lua), m_name(name), m_value(error)
+	, m_valueLength((int)error.length()), m_valueType(LUA_TNONE)
+	, m_hasFields(false) {
 }
 
 bool LuaVar::CheckHasFields(lua_State *L, int valueIdx) const {
@@ -127,10 +160,12 @@ bool LuaVar::CheckHasFields(lua_State *L, int valueIdx) const {
 	return false;
 }
 
-int LuaVar::RegisterTable(lua_State *L, int valueIdx) {
+LuaVarRef LuaVar::RegisterTable(lua_State *L, int valueIdx) {
+	LuaHandle lua(L);
+
 	if (!lua_istable(L, valueIdx)) {
 		if (lua_getmetatable(L, valueIdx) == 0) {
-			return -1;
+			return LuaVarRef(lua);
 		}
 		lua_pop(L, 1);
 	}
@@ -138,122 +173,106 @@ int LuaVar::RegisterTable(lua_State *L, int valueIdx) {
 	// OriginalObj couldn't be handled correctly.
 	if (lua_islightuserdata(L, valueIdx)
 		&& lua_topointer(L, valueIdx) == &context::llutil_address_for_internal_table) {
-		return -1;
+		return LuaVarRef(lua);
 	}
 
-	int top = lua_gettop(L);
+	int generation = 0;
+	int slot = context::llutil_registerhandle(L, valueIdx, generation);
+	return LuaVarRef(lua, slot, generation);
+}
+#endif
 
-	// Try to do "table = registry[&OriginalObj]"
-	lua_pushlightuserdata(L, (void *)&context::llutil_address_for_internal_table);
-	lua_rawget(L, LUA_REGISTRYINDEX);
-	if (!lua_istable(L, -1)) {
-		lua_pop(L, 1);
 
-		// local newtable = {}
-		lua_newtable(L);
+/*-----------------------------------------------------------------*/
+#ifdef LLDEBUG_CONTEXT
+LuaBacktrace::LuaBacktrace(const LuaHandle &lua,
+						   const std::string &name,
+						   int sourceId,
+						   int line, int level)
+	: m_lua(lua), m_funcName(name), m_sourceId(sourceId)
+	, m_line(line), m_level(level) {
+}
+#endif
 
-		// setmetatable(newtable, {__mode="vk"})
-		lua_newtable(L);
-		lua_pushliteral(L, "__mode");
-		lua_pushliteral(L, "vk");
-		lua_rawset(L, -3);
-		lua_setmetatable(L, -2);
+LuaBacktrace::LuaBacktrace()
+	: m_sourceId(-1), m_line(-1), m_level(-1) {
+}
 
-		// newtable[0] = 1 -- initial index
-		lua_pushnumber(L, (lua_Number)1);
-		lua_rawseti(L, -2, 0);
+LuaBacktrace::~LuaBacktrace() {
+}
 
-		// registry[&OriginalObj] = newtable
-		lua_pushlightuserdata(L, (void *)&context::llutil_address_for_internal_table);
-		lua_pushvalue(L, -2);
-		lua_rawset(L, LUA_REGISTRYINDEX);
-	}
 
-	// table is registry[&OriginalObj]
-	int table = lua_gettop(L);
-	int n = 0; // use after
+/*-----------------------------------------------------------------*/
+LuaVarFilter::LuaVarFilter()
+	: m_typeMask(~0), m_hideFunctions(false), m_hideCFunctions(false)
+	, m_maxCount(-1), m_sortOrder(SORTORDER_NONE) {
+}
 
-	// Check table[valueIdx] is number.
-	lua_pushvalue(L, valueIdx);
-	lua_rawget(L, table);
-	if (lua_isnumber(L, -1)) {
-		n = (int)lua_tonumber(L, -1);
-		lua_pop(L, 1);
+LuaVarFilter::~LuaVarFilter() {
+}
 
-		// Check table[n] is table.
-		lua_rawgeti(L, table, n);
-		if (lua_istable(L, -1)) {
-			// No problems.
-			lua_pop(L, 1);
+bool LuaVarFilter::MatchName(const std::string &name) const {
+	if (m_namePattern.empty()) {
+		return true;
+	}
+
+	const char *p = m_namePattern.c_str();
+	const char *s = name.c_str();
+	const char *starP = NULL; // the pattern next to the last '*'
+	const char *starS = NULL; // the name that the last '*' matched to
+
+	while (*s != '\0') {
+		if (*p == '*') {
+			starP = ++p;
+			starS = s;
+		}
+		else if (*p == '?' || *p == *s) {
+			++p;
+			++s;
+		}
+		else if (starP != NULL) {
+			// Let the last '*' match one more character.
+			p = starP;
+			s = ++starS;
 		}
 		else {
-			lua_pop(L, 1);
-
-			// table[n] = valueIdx, again
-			lua_pushvalue(L, valueIdx);
-			lua_rawseti(L, table, n);
+			return false;
 		}
 	}
-	else {
-		lua_pop(L, 1);
-
-		// n = table[0]
-		lua_rawgeti(L, table, 0);
-		n = (int)lua_tonumber(L, -1);
-		lua_pop(L, 1);
-
-		// table[0] = n + 1
-		lua_pushnumber(L, (lua_Number)(n + 1));
-		lua_rawseti(L, table, 0);
 
-		// table[valueIdx] = n
-		lua_pushvalue(L, valueIdx);
-		lua_pushnumber(L, (lua_Number)n);
-		lua_rawset(L, table);
-
-		// table[n] = valueIdx
-		lua_pushvalue(L, valueIdx);
-		lua_rawseti(L, table, n);
+	while (*p == '*') {
+		++p;
 	}
-
-	lua_pop(L, 1);
-	assert(top == lua_gettop(L));
-	(void)top;
-	return n;
+	return (*p == '\0');
 }
 
-int LuaVar::PushTable(lua_State *L) const {
-	if (m_tableIdx < 0) {
-		return -1;
-	}
-
-	// push registry[&OriginalObj][m_tableIdx]
-	lua_pushlightuserdata(L, (void *)&context::llutil_address_for_internal_table);
-	lua_rawget(L, LUA_REGISTRYINDEX);
-	lua_rawgeti(L, -1, m_tableIdx);
-	lua_remove(L, -2);
-	return 0;
+static bool less_name(const LuaVar &x, const LuaVar &y) {
+	return (x.GetName() < y.GetName());
 }
-#endif
 
+static bool less_type(const LuaVar &x, const LuaVar &y) {
+	if (x.GetValueType() != y.GetValueType()) {
+		return (x.GetValueType() < y.GetValueType());
+	}
 
-/*-----------------------------------------------------------------*/
-#ifdef LLDEBUG_CONTEXT
-LuaBacktrace::LuaBacktrace(const LuaHandle &lua,
-						   const std::string &name,
-						   const std::string &sourceKey,
-						   const std::string &sourceTitle,
-						   int line, int level)
-	: m_lua(lua), m_funcName(name)
-	, m_key(sourceKey), m_sourceTitle(sourceTitle)
-	, m_line(line), m_level(level) {
+	return less_name(x, y);
 }
-#endif
 
-LuaBacktrace::LuaBacktrace() {
-}
+void LuaVarFilter::Arrange(LuaVarList &vars) const {
+	switch (m_sortOrder) {
+	case SORTORDER_NONE:
+		break;
+	case SORTORDER_NAME:
+		std::stable_sort(vars.begin(), vars.end(), less_name);
+		break;
+	case SORTORDER_TYPE:
+		std::stable_sort(vars.begin(), vars.end(), less_type);
+		break;
+	}
 
-LuaBacktrace::~LuaBacktrace() {
+	if (m_maxCount >= 0 && vars.size() > (LuaVarList::size_type)m_maxCount) {
+		vars.resize(m_maxCount);
+	}
 }
 
 } // end of namespace lldebug
@@ -142,17 +142,88 @@ private:
 };
 
 
+/**
+ * @brief Small fixed-size reference to a table or userdata of the debuggee.
+ *
+ * This is all the frame has to send back to get the fields of a variable.
+ */
+class LuaVarRef {
+public:
+	explicit LuaVarRef(const LuaHandle &lua = LuaHandle(),
+					   int tableIdx = -1, int generation = 0);
+	~LuaVarRef();
+
+	/// Is this object valid ?
+	bool IsOk() const {
+		return (m_tableIdx > 0);
+	}
+
+	/// Get the lua handle.
+	const LuaHandle &GetLua() const {
+		return m_lua;
+	}
+
+	/// Get the index of the internal table.
+	int GetTableIdx() const {
+		return m_tableIdx;
+	}
+
+	/// Get the generation of the index.
+	int GetGeneration() const {
+		return m_generation;
+	}
+
+	/// Get the index of the value that is kept for the full value fetch.
+	/** It's valid only in the update which made this.
+	 */
+	int GetValueIdx() const {
+		return m_valueIdx;
+	}
+
+	/// Set the index of the kept value.
+	void SetValueIdx(int valueIdx) {
+		m_valueIdx = valueIdx;
+	}
+
+#ifdef LLDEBUG_CONTEXT
+	/// Push the referenced value.
+	int PushTable(lua_State *L) const;
+#endif
+
+private:
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive& ar, const unsigned int) {
+		ar & LLDEBUG_MEMBER_NVP(lua);
+		ar & LLDEBUG_MEMBER_NVP(tableIdx);
+		ar & LLDEBUG_MEMBER_NVP(generation);
+		ar & LLDEBUG_MEMBER_NVP(valueIdx);
+	}
+
+private:
+	LuaHandle m_lua;
+	int m_tableIdx;
+	int m_generation;
+	int m_valueIdx;
+};
+
+
 /**
  * @brief Infomation of a lua variable.
+ *
+ * It consists of the reference and the display payload.
  */
 class LuaVar {
 public:
 #ifdef LLDEBUG_CONTEXT
-	LuaVar(const LuaHandle &lua, const std::string &name, int valueIdx);
+	LuaVar(const LuaHandle &lua, const std::string &name, int valueIdx,
+		   bool isNativeFormatter = false, int previewLength = -1);
 	LuaVar(const LuaHandle &lua, const std::string &name, const std::string &error);
 
 	/// Push the table value.
-	int PushTable(lua_State *L) const;
+	int PushTable(lua_State *L) const {
+		return m_ref.PushTable(L);
+	}
 #endif
 	explicit LuaVar();
 	virtual ~LuaVar();
@@ -162,9 +233,14 @@ public:
 		return (m_valueType >= 0);
 	}
 
+	/// Get the reference to this variable.
+	const LuaVarRef &GetRef() const {
+		return m_ref;
+	}
+
 	/// Get the lua handle.
 	const LuaHandle &GetLua() const {
-		return m_lua;
+		return m_ref.GetLua();
 	}
 
 	/// Get the name of the variable or table's key.
@@ -173,10 +249,22 @@ public:
 	}
 
 	/// Get the value by string.
+	/** It may be only the preview, see 'IsTruncated'.
+	 */
 	const std::string &GetValue() const {
 		return m_value;
 	}
 
+	/// Get the length of the whole value string.
+	int GetValueLength() const {
+		return m_valueLength;
+	}
+
+	/// Is the value string cut to the preview length ?
+	bool IsTruncated() const {
+		return ((int)m_value.length() < m_valueLength);
+	}
+
 	/// Get the type by integer.
 	int GetValueType() const {
 		return m_valueType;
@@ -197,28 +285,28 @@ protected:
 	/// Check whether the variable has fields.
 	bool CheckHasFields(lua_State *L, int valueIdx) const;
 
-	/// Register and save valueIdx to the internal table.
-	int RegisterTable(lua_State *L, int valueIdx);
+	/// Register valueIdx to the handle table and return the reference.
+	LuaVarRef RegisterTable(lua_State *L, int valueIdx);
 #endif
 
 private:
 	friend class boost::serialization::access;
 	template<class Archive>
 	void serialize(Archive& ar, const unsigned int) {
-		ar & LLDEBUG_MEMBER_NVP(lua);
+		ar & LLDEBUG_MEMBER_NVP(ref);
 		ar & LLDEBUG_MEMBER_NVP(name);
 		ar & LLDEBUG_MEMBER_NVP(value);
+		ar & LLDEBUG_MEMBER_NVP(valueLength);
 		ar & LLDEBUG_MEMBER_NVP(valueType);
-		ar & LLDEBUG_MEMBER_NVP(tableIdx);
 		ar & LLDEBUG_MEMBER_NVP(hasFields);
 	}
 
 private:
-	LuaHandle m_lua;
+	LuaVarRef m_ref;
 	std::string m_name;
 	std::string m_value;
+	int m_valueLength;
 	int m_valueType;
-	int m_tableIdx;
 	bool m_hasFields;
 };
 
@@ -231,8 +319,7 @@ public:
 #ifdef LLDEBUG_CONTEXT
 	explicit LuaBacktrace(const LuaHandle &lua,
 						  const std::string &name,
-						  const std::string &sourceKey,
-						  const std::string &sourceTitle,
+						  int sourceId,
 						  int line, int level);
 #endif
 	explicit LuaBacktrace();
@@ -248,14 +335,9 @@ public:
 		return m_funcName;
 	}
 
-	/// Get the source key.
-	const std::string &GetKey() const {
-		return m_key;
-	}
-
-	/// Get the source title.
-	const std::string &GetTitle() const {
-		return m_sourceTitle;
+	/// Get the source id. It's minus if the source isn't managed.
+	int GetSourceId() const {
+		return m_sourceId;
 	}
 
 	/// Get the line number.
@@ -274,8 +356,7 @@ private:
 	void serialize(Archive& ar, const unsigned int) {
 		ar & LLDEBUG_MEMBER_NVP(lua);
 		ar & LLDEBUG_MEMBER_NVP(funcName);
-		ar & LLDEBUG_MEMBER_NVP(key);
-		ar & LLDEBUG_MEMBER_NVP(sourceTitle);
+		ar & LLDEBUG_MEMBER_NVP(sourceId);
 		ar & LLDEBUG_MEMBER_NVP(line);
 		ar & LLDEBUG_MEMBER_NVP(level);
 	}
@@ -283,8 +364,7 @@ private:
 public:
 	LuaHandle m_lua;
 	std::string m_funcName;
-	std::string m_key;
-	std::string m_sourceTitle;
+	int m_sourceId;
 	int m_line;
 	int m_level;
 };
@@ -293,6 +373,186 @@ typedef std::vector<LuaVar> LuaVarList;
 typedef std::vector<LuaVarList> LuaMultiVarList;
 typedef std::vector<LuaBacktrace> LuaBacktraceList;
 
+/// Results of the registered watches, watch id -> var.
+typedef std::map<int, LuaVar> LuaWatchResults;
+
+/// Prefetched fields, index of the var in the list -> its fields.
+typedef std::map<int, LuaVarList> LuaVarListMap;
+
+/// Heats (samples or executed) of the lines, line -> heat.
+typedef std::map<int, int> LuaLineHeats;
+/// Changed heats of the sources, source id -> heats.
+typedef std::map<int, LuaLineHeats> LuaLineHeatsMap;
+
+
+/**
+ * @brief Filter and sort order of the var list.
+ *
+ * It's applied by the context before any LuaVar objects are made.
+ */
+class LuaVarFilter {
+public:
+	enum SortOrder {
+		SORTORDER_NONE,
+		SORTORDER_NAME,
+		SORTORDER_TYPE,
+	};
+
+public:
+	explicit LuaVarFilter();
+	~LuaVarFilter();
+
+	/// Get the mask bit of the lua type (LUA_TXXX).
+	static int GetTypeBit(int type) {
+		return (1 << (type + 1));
+	}
+
+	/// Get the name pattern, '*' and '?' are the wildcards.
+	const std::string &GetNamePattern() const {
+		return m_namePattern;
+	}
+
+	/// Set the name pattern, the empty string matches all names.
+	void SetNamePattern(const std::string &pattern) {
+		m_namePattern = pattern;
+	}
+
+	/// Get the mask of the shown types.
+	int GetTypeMask() const {
+		return m_typeMask;
+	}
+
+	/// Set the mask of the shown types, which consists of 'GetTypeBit'.
+	void SetTypeMask(int typeMask) {
+		m_typeMask = typeMask;
+	}
+
+	/// Are all functions hidden ?
+	bool IsHideFunctions() const {
+		return m_hideFunctions;
+	}
+
+	/// Set whether all functions are hidden.
+	void SetHideFunctions(bool hide) {
+		m_hideFunctions = hide;
+	}
+
+	/// Are the C functions hidden ?
+	bool IsHideCFunctions() const {
+		return m_hideCFunctions;
+	}
+
+	/// Set whether the C functions are hidden.
+	void SetHideCFunctions(bool hide) {
+		m_hideCFunctions = hide;
+	}
+
+	/// Get the max count of the vars. It's minus if there is no limit.
+	int GetMaxCount() const {
+		return m_maxCount;
+	}
+
+	/// Set the max count of the vars.
+	void SetMaxCount(int maxCount) {
+		m_maxCount = maxCount;
+	}
+
+	/// Get the sort order.
+	SortOrder GetSortOrder() const {
+		return m_sortOrder;
+	}
+
+	/// Set the sort order.
+	void SetSortOrder(SortOrder sortOrder) {
+		m_sortOrder = sortOrder;
+	}
+
+	/// Does the name match the pattern ?
+	bool MatchName(const std::string &name) const;
+
+	/// Is the type shown ?
+	bool MatchType(int type) const {
+		return ((m_typeMask & GetTypeBit(type)) != 0);
+	}
+
+	/// Sort the vars and cut them to the max count.
+	void Arrange(LuaVarList &vars) const;
+
+private:
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive& ar, const unsigned int) {
+		ar & LLDEBUG_MEMBER_NVP(namePattern);
+		ar & LLDEBUG_MEMBER_NVP(typeMask);
+		ar & LLDEBUG_MEMBER_NVP(hideFunctions);
+		ar & LLDEBUG_MEMBER_NVP(hideCFunctions);
+		ar & LLDEBUG_MEMBER_NVP(maxCount);
+		ar & LLDEBUG_MEMBER_NVP(sortOrder);
+	}
+
+private:
+	std::string m_namePattern;
+	int m_typeMask;
+	bool m_hideFunctions;
+	bool m_hideCFunctions;
+	int m_maxCount;
+	SortOrder m_sortOrder;
+};
+
+
+/// The default max count of the instructions that an eval can run.
+#ifndef LLDEBUG_DEFAULT_EVALINSTRUCTIONS
+#define LLDEBUG_DEFAULT_EVALINSTRUCTIONS 10000000
+#endif
+
+/// The default max time (msec) that an eval can take.
+#ifndef LLDEBUG_DEFAULT_EVALTIMEOUT
+#define LLDEBUG_DEFAULT_EVALTIMEOUT 3000
+#endif
+
+/**
+ * @brief Limits of an eval, the eval is aborted if it exceeds them.
+ *
+ * The minus value means no limit.
+ */
+class LuaEvalBudget {
+public:
+	explicit LuaEvalBudget(int maxInstructions = LLDEBUG_DEFAULT_EVALINSTRUCTIONS,
+						   int timeout = LLDEBUG_DEFAULT_EVALTIMEOUT)
+		: m_maxInstructions(maxInstructions), m_timeout(timeout) {
+	}
+
+	~LuaEvalBudget() {
+	}
+
+	/// Get the max count of the instructions.
+	int GetMaxInstructions() const {
+		return m_maxInstructions;
+	}
+
+	/// Get the max time (msec).
+	int GetTimeout() const {
+		return m_timeout;
+	}
+
+	/// Is there no limit ?
+	bool IsUnlimited() const {
+		return (m_maxInstructions < 0 && m_timeout < 0);
+	}
+
+private:
+	friend class boost::serialization::access;
+	template<class Archive>
+	void serialize(Archive& ar, const unsigned int) {
+		ar & LLDEBUG_MEMBER_NVP(maxInstructions);
+		ar & LLDEBUG_MEMBER_NVP(timeout);
+	}
+
+private:
+	int m_maxInstructions;
+	int m_timeout;
+};
+
 } // end of namespace lldebug
 
 #endif
@@ -102,6 +102,20 @@ struct Serializer {
 		return stream.container();
 	}
 
+	template<class T0, class T1, class T2, class T3, class T4>
+	static container_type ToData(const T0 &value0, const T1 &value1, const T2 &value2, const T3 &value3, const T4 &value4) {
+		vector_ostream stream;
+		serialize_oarchive ar(stream);
+
+		ar << BOOST_SERIALIZATION_NVP(value0);
+		ar << BOOST_SERIALIZATION_NVP(value1);
+		ar << BOOST_SERIALIZATION_NVP(value2);
+		ar << BOOST_SERIALIZATION_NVP(value3);
+		ar << BOOST_SERIALIZATION_NVP(value4);
+		stream.flush();
+		return stream.container();
+	}
+
 	template<class T0>
 	static void ToValue(const container_type &data, T0 &value0) {
 		vector_istream stream(data);
@@ -139,6 +153,18 @@ struct Serializer {
 		ar >> BOOST_SERIALIZATION_NVP(value2);
 		ar >> BOOST_SERIALIZATION_NVP(value3);
 	}
+
+	template<class T0, class T1, class T2, class T3, class T4>
+	static void ToValue(const container_type &data, T0 &value0, T1 &value1, T2 &value2, T3 &value3, T4 &value4) {
+		vector_istream stream(data);
+		serialize_iarchive ar(stream);
+
+		ar >> BOOST_SERIALIZATION_NVP(value0);
+		ar >> BOOST_SERIALIZATION_NVP(value1);
+		ar >> BOOST_SERIALIZATION_NVP(value2);
+		ar >> BOOST_SERIALIZATION_NVP(value3);
+		ar >> BOOST_SERIALIZATION_NVP(value4);
+	}
 };
 
 
@@ -160,14 +186,24 @@ void CommandData::Set_ChangedState(bool isBreak) {
 	m_data = Serializer::ToData(isBreak);
 }
 
-void CommandData::Get_UpdateSource(std::string &key, int &line,
-								   int &updateCount,
-								   bool &isRefreshOnly) const {
-	Serializer::ToValue(m_data, key, line, updateCount, isRefreshOnly);
+void CommandData::Get_UpdateSource(int &sourceId, int &line,
+								   int &updateCount, bool &isRefreshOnly,
+								   LuaWatchResults &watches) const {
+	Serializer::ToValue(m_data, sourceId, line, updateCount,
+		isRefreshOnly, watches);
+}
+void CommandData::Set_UpdateSource(int sourceId, int line,
+								   int updateCount, bool isRefreshOnly,
+								   const LuaWatchResults &watches) {
+	m_data = Serializer::ToData(sourceId, line, updateCount,
+		isRefreshOnly, watches);
+}
+
+void CommandData::Get_ForceUpdateSource(bool &withWatches) const {
+	Serializer::ToValue(m_data, withWatches);
 }
-void CommandData::Set_UpdateSource(const std::string &key, int line,
-								   int updateCount, bool isRefreshOnly) {
-	m_data = Serializer::ToData(key, line, updateCount, isRefreshOnly);
+void CommandData::Set_ForceUpdateSource(bool withWatches) {
+	m_data = Serializer::ToData(withWatches);
 }
 
 void CommandData::Get_AddedSource(Source &source) const {
@@ -177,13 +213,13 @@ void CommandData::Set_AddedSource(const Source &source) {
 	m_data = Serializer::ToData(source);
 }
 
-void CommandData::Get_SaveSource(std::string &key,
+void CommandData::Get_SaveSource(int &sourceId,
 									   string_array &sources) const {
-	Serializer::ToValue(m_data, key, sources);
+	Serializer::ToValue(m_data, sourceId, sources);
 }
-void CommandData::Set_SaveSource(const std::string &key,
+void CommandData::Set_SaveSource(int sourceId,
 									   const string_array &sources) {
-	m_data = Serializer::ToData(key, sources);
+	m_data = Serializer::ToData(sourceId, sources);
 }
 
 void CommandData::Get_SetUpdateCount(int &updateCount) const {
@@ -229,60 +265,137 @@ void CommandData::Set_OutputLog(const LogData &logData) {
 }
 
 void CommandData::Get_EvalsToVarList(string_array &evals,
-									 LuaStackFrame &stackFrame) const {
-	Serializer::ToValue(m_data, evals, stackFrame);
+									 LuaStackFrame &stackFrame,
+									 LuaEvalBudget &budget) const {
+	Serializer::ToValue(m_data, evals, stackFrame, budget);
 }
 void CommandData::Set_EvalsToVarList(const string_array &evals,
-									 const LuaStackFrame &stackFrame) {
-	m_data = Serializer::ToData(evals, stackFrame);
+									 const LuaStackFrame &stackFrame,
+									 const LuaEvalBudget &budget) {
+	m_data = Serializer::ToData(evals, stackFrame, budget);
 }
 
 void CommandData::Get_EvalToMultiVar(std::string &eval,
-									 LuaStackFrame &stackFrame) const {
-	Serializer::ToValue(m_data, eval, stackFrame);
+									 LuaStackFrame &stackFrame,
+									 LuaEvalBudget &budget) const {
+	Serializer::ToValue(m_data, eval, stackFrame, budget);
 }
 void CommandData::Set_EvalToMultiVar(const std::string &eval,
-									 const LuaStackFrame &stackFrame) {
-	m_data = Serializer::ToData(eval, stackFrame);
+									 const LuaStackFrame &stackFrame,
+									 const LuaEvalBudget &budget) {
+	m_data = Serializer::ToData(eval, stackFrame, budget);
 }
 
 void CommandData::Get_EvalToVar(std::string &eval,
-								LuaStackFrame &stackFrame) const {
-	Serializer::ToValue(m_data, eval, stackFrame);
+								LuaStackFrame &stackFrame,
+								LuaEvalBudget &budget) const {
+	Serializer::ToValue(m_data, eval, stackFrame, budget);
 }
 void CommandData::Set_EvalToVar(const std::string &eval,
-								const LuaStackFrame &stackFrame) {
-	m_data = Serializer::ToData(eval, stackFrame);
+								const LuaStackFrame &stackFrame,
+								const LuaEvalBudget &budget) {
+	m_data = Serializer::ToData(eval, stackFrame, budget);
 }
 
-void CommandData::Get_RequestFieldVarList(LuaVar &var) const {
-	Serializer::ToValue(m_data, var);
+void CommandData::Get_AddWatch(int &watchId, std::string &eval) const {
+	Serializer::ToValue(m_data, watchId, eval);
 }
-void CommandData::Set_RequestFieldVarList(const LuaVar &var) {
-	m_data = Serializer::ToData(var);
+void CommandData::Set_AddWatch(int watchId, const std::string &eval) {
+	m_data = Serializer::ToData(watchId, eval);
+}
+
+void CommandData::Get_RemoveWatch(int &watchId) const {
+	Serializer::ToValue(m_data, watchId);
+}
+void CommandData::Set_RemoveWatch(int watchId) {
+	m_data = Serializer::ToData(watchId);
+}
+
+void CommandData::Get_StartProfiler(lldebug_ProfileMode &mode,
+									int &interval) const {
+	Serializer::ToValue(m_data, mode, interval);
+}
+void CommandData::Set_StartProfiler(lldebug_ProfileMode mode, int interval) {
+	m_data = Serializer::ToData(mode, interval);
+}
+
+void CommandData::Get_RequestProfile(lldebug_ProfileFormat &format) const {
+	Serializer::ToValue(m_data, format);
+}
+void CommandData::Set_RequestProfile(lldebug_ProfileFormat format) {
+	m_data = Serializer::ToData(format);
+}
+
+void CommandData::Get_RequestLineHeats(std::vector<int> &sourceIds) const {
+	Serializer::ToValue(m_data, sourceIds);
+}
+void CommandData::Set_RequestLineHeats(const std::vector<int> &sourceIds) {
+	m_data = Serializer::ToData(sourceIds);
+}
+
+void CommandData::Get_RequestFieldVarList(LuaVarRef &ref,
+											int &updateCount,
+											LuaVarFilter &filter,
+											int &prefetchBytes,
+											int &prefetchDepth) const {
+	Serializer::ToValue(m_data, ref, updateCount, filter,
+						prefetchBytes, prefetchDepth);
+}
+void CommandData::Set_RequestFieldVarList(const LuaVarRef &ref,
+											int updateCount,
+											const LuaVarFilter &filter,
+											int prefetchBytes,
+											int prefetchDepth) {
+	m_data = Serializer::ToData(ref, updateCount, filter,
+								prefetchBytes, prefetchDepth);
 }
 
 void CommandData::Get_RequestLocalVarList(LuaStackFrame &stackFrame,
 										  bool &checkLocal,
 										  bool &checkUpvalue,
-										  bool &checkEnviron) const {
+										  bool &checkEnviron,
+										  LuaVarFilter &filter) const {
 	Serializer::ToValue(m_data, stackFrame,
-		checkLocal, checkUpvalue, checkEnviron);
+		checkLocal, checkUpvalue, checkEnviron, filter);
 }
 
 void CommandData::Set_RequestLocalVarList(const LuaStackFrame &stackFrame,
 										  bool checkLocal,
 										  bool checkUpvalue,
-										  bool checkEnviron) {
+										  bool checkEnviron,
+										  const LuaVarFilter &filter) {
 	m_data = Serializer::ToData(stackFrame,
-		checkLocal, checkUpvalue, checkEnviron);
+		checkLocal, checkUpvalue, checkEnviron, filter);
 }
 
-void CommandData::Get_RequestSource(std::string &key) {
-	Serializer::ToValue(m_data, key);
+void CommandData::Get_RequestGlobalVarList(LuaVarFilter &filter) const {
+	Serializer::ToValue(m_data, filter);
 }
-void CommandData::Set_RequestSource(const std::string &key) {
-	m_data = Serializer::ToData(key);
+void CommandData::Set_RequestGlobalVarList(const LuaVarFilter &filter) {
+	m_data = Serializer::ToData(filter);
+}
+
+void CommandData::Get_RequestRegistryVarList(LuaVarFilter &filter) const {
+	Serializer::ToValue(m_data, filter);
+}
+void CommandData::Set_RequestRegistryVarList(const LuaVarFilter &filter) {
+	m_data = Serializer::ToData(filter);
+}
+
+void CommandData::Get_RequestSource(int &sourceId) {
+	Serializer::ToValue(m_data, sourceId);
+}
+void CommandData::Set_RequestSource(int sourceId) {
+	m_data = Serializer::ToData(sourceId);
+}
+
+void CommandData::Get_RequestVarValue(LuaVarRef &ref, int &updateCount,
+									  int &offset, int &length) const {
+	Serializer::ToValue(m_data, ref, updateCount, offset, length);
+}
+void CommandData::Set_RequestVarValue(const LuaVarRef &ref, int updateCount,
+									  int offset, int length) {
+	m_data = Serializer::ToData(ref, updateCount, offset, length);
 }
 
 void CommandData::Get_ValueString(std::string &str) const {
@@ -306,6 +419,16 @@ void CommandData::Set_ValueVarList(const LuaVarList &vars) {
 	m_data = Serializer::ToData(vars);
 }
 
+/// The vars come first, so 'Get_ValueVarList(vars)' can also read it.
+void CommandData::Get_ValueVarList(LuaVarList &vars,
+								   LuaVarListMap &prefetched) const {
+	Serializer::ToValue(m_data, vars, prefetched);
+}
+void CommandData::Set_ValueVarList(const LuaVarList &vars,
+								   const LuaVarListMap &prefetched) {
+	m_data = Serializer::ToData(vars, prefetched);
+}
+
 void CommandData::Get_ValueVar(LuaVar &var) const {
 	Serializer::ToValue(m_data, var);
 }
@@ -320,5 +443,14 @@ void CommandData::Set_ValueBacktraceList(const LuaBacktraceList &backtraces) {
 	m_data = Serializer::ToData(backtraces);
 }
 
+void CommandData::Get_ValueLineHeats(int &generation,
+									 LuaLineHeatsMap &heats) const {
+	Serializer::ToValue(m_data, generation, heats);
+}
+void CommandData::Set_ValueLineHeats(int generation,
+									 const LuaLineHeatsMap &heats) {
+	m_data = Serializer::ToData(generation, heats);
+}
+
 } // end of namespace net
 } // end of namespace lldebug
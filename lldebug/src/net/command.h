@@ -28,6 +28,7 @@
 #define __LLDEBUG_COMMAND_H__
 
 #include "llencoding.h"
+#include "llprofile.h"
 #include "sysinfo.h"
 #include "luainfo.h"
 
@@ -72,6 +73,13 @@ enum RemoteCommandType {
 	REMOTECOMMANDTYPE_EVALS_TO_VARLIST,
 	REMOTECOMMANDTYPE_EVAL_TO_MULTIVAR,
 	REMOTECOMMANDTYPE_EVAL_TO_VAR,
+	REMOTECOMMANDTYPE_ADD_WATCH,
+	REMOTECOMMANDTYPE_REMOVE_WATCH,
+
+	REMOTECOMMANDTYPE_START_PROFILER,
+	REMOTECOMMANDTYPE_STOP_PROFILER,
+	REMOTECOMMANDTYPE_REQUEST_PROFILE,
+	REMOTECOMMANDTYPE_REQUEST_LINEHEATS,
 
 	REMOTECOMMANDTYPE_REQUEST_FIELDSVARLIST,
 	REMOTECOMMANDTYPE_REQUEST_LOCALVARLIST,
@@ -80,6 +88,7 @@ enum RemoteCommandType {
 	REMOTECOMMANDTYPE_REQUEST_STACKLIST,
 	REMOTECOMMANDTYPE_REQUEST_SOURCE,
 	REMOTECOMMANDTYPE_REQUEST_BACKTRACELIST,
+	REMOTECOMMANDTYPE_REQUEST_VARVALUE,
 
 	REMOTECOMMANDTYPE_SUCCESSED,
 	REMOTECOMMANDTYPE_FAILED,
@@ -89,6 +98,7 @@ enum RemoteCommandType {
 	REMOTECOMMANDTYPE_VALUE_VARLIST,
 	REMOTECOMMANDTYPE_VALUE_VAR,
 	REMOTECOMMANDTYPE_VALUE_BACKTRACELIST,
+	REMOTECOMMANDTYPE_VALUE_LINEHEATS,
 };
 
 /**
@@ -144,16 +154,19 @@ public:
 	void Get_ChangedState(bool &isBreak) const;
 	void Set_ChangedState(bool isBreak);
 
-	void Get_UpdateSource(std::string &key, int &line, int &updateCount,
-						  bool &isRefreshOnly) const;
-	void Set_UpdateSource(const std::string &key, int line, int updateCount,
-						  bool isRefreshOnly);
+	void Get_UpdateSource(int &sourceId, int &line, int &updateCount,
+						  bool &isRefreshOnly, LuaWatchResults &watches) const;
+	void Set_UpdateSource(int sourceId, int line, int updateCount,
+						  bool isRefreshOnly, const LuaWatchResults &watches);
+
+	void Get_ForceUpdateSource(bool &withWatches) const;
+	void Set_ForceUpdateSource(bool withWatches);
 
 	void Get_AddedSource(Source &source) const;
 	void Set_AddedSource(const Source &source);
 
-	void Get_SaveSource(std::string &key, string_array &sources) const;
-	void Set_SaveSource(const std::string &key, const string_array &sources);
+	void Get_SaveSource(int &sourceId, string_array &sources) const;
+	void Set_SaveSource(int sourceId, const string_array &sources);
 
 	void Get_SetUpdateCount(int &updateCount) const;
 	void Set_SetUpdateCount(int updateCount);
@@ -173,25 +186,63 @@ public:
 	void Get_OutputLog(LogData &logData) const;
 	void Set_OutputLog(const LogData &logData);
 
-	void Get_EvalsToVarList(string_array &evals, LuaStackFrame &stackFrame) const;
-	void Set_EvalsToVarList(const string_array &evals, const LuaStackFrame &stackFrame);
+	void Get_EvalsToVarList(string_array &evals, LuaStackFrame &stackFrame,
+							LuaEvalBudget &budget) const;
+	void Set_EvalsToVarList(const string_array &evals, const LuaStackFrame &stackFrame,
+							const LuaEvalBudget &budget);
+
+	void Get_EvalToMultiVar(std::string &eval, LuaStackFrame &stackFrame,
+							LuaEvalBudget &budget) const;
+	void Set_EvalToMultiVar(const std::string &eval, const LuaStackFrame &stackFrame,
+							const LuaEvalBudget &budget);
+
+	void Get_EvalToVar(std::string &eval, LuaStackFrame &stackFrame,
+					   LuaEvalBudget &budget) const;
+	void Set_EvalToVar(const std::string &eval, const LuaStackFrame &stackFrame,
+					   const LuaEvalBudget &budget);
+
+	void Get_AddWatch(int &watchId, std::string &eval) const;
+	void Set_AddWatch(int watchId, const std::string &eval);
+
+	void Get_RemoveWatch(int &watchId) const;
+	void Set_RemoveWatch(int watchId);
 
-	void Get_EvalToMultiVar(std::string &eval, LuaStackFrame &stackFrame) const;
-	void Set_EvalToMultiVar(const std::string &eval, const LuaStackFrame &stackFrame);
+	void Get_StartProfiler(lldebug_ProfileMode &mode, int &interval) const;
+	void Set_StartProfiler(lldebug_ProfileMode mode, int interval);
 
-	void Get_EvalToVar(std::string &eval, LuaStackFrame &stackFrame) const;
-	void Set_EvalToVar(const std::string &eval, const LuaStackFrame &stackFrame);
+	void Get_RequestProfile(lldebug_ProfileFormat &format) const;
+	void Set_RequestProfile(lldebug_ProfileFormat format);
 
-	void Get_RequestFieldVarList(LuaVar &var) const;
-	void Set_RequestFieldVarList(const LuaVar &var);
+	void Get_RequestLineHeats(std::vector<int> &sourceIds) const;
+	void Set_RequestLineHeats(const std::vector<int> &sourceIds);
+
+	void Get_RequestFieldVarList(LuaVarRef &ref, int &updateCount,
+								 LuaVarFilter &filter, int &prefetchBytes,
+								 int &prefetchDepth) const;
+	void Set_RequestFieldVarList(const LuaVarRef &ref, int updateCount,
+								 const LuaVarFilter &filter, int prefetchBytes,
+								 int prefetchDepth);
 
 	void Get_RequestLocalVarList(LuaStackFrame &stackFrame, bool &checkLocal,
-								 bool &checkUpvalue, bool &checkEnviron) const;
+								 bool &checkUpvalue, bool &checkEnviron,
+								 LuaVarFilter &filter) const;
 	void Set_RequestLocalVarList(const LuaStackFrame &stackFrame, bool checkLocal,
-								 bool checkUpvalue, bool checkEnviron);
+								 bool checkUpvalue, bool checkEnviron,
+								 const LuaVarFilter &filter);
+
+	void Get_RequestGlobalVarList(LuaVarFilter &filter) const;
+	void Set_RequestGlobalVarList(const LuaVarFilter &filter);
+
+	void Get_RequestRegistryVarList(LuaVarFilter &filter) const;
+	void Set_RequestRegistryVarList(const LuaVarFilter &filter);
 
-	void Get_RequestSource(std::string &key);
-	void Set_RequestSource(const std::string &key);
+	void Get_RequestSource(int &sourceId);
+	void Set_RequestSource(int sourceId);
+
+	void Get_RequestVarValue(LuaVarRef &ref, int &updateCount,
+							 int &offset, int &length) const;
+	void Set_RequestVarValue(const LuaVarRef &ref, int updateCount,
+							 int offset, int length);
 
 	void Get_ValueString(std::string &str) const;
 	void Set_ValueString(const std::string &str);
@@ -202,12 +253,18 @@ public:
 	void Get_ValueVarList(LuaVarList &vars) const;
 	void Set_ValueVarList(const LuaVarList &vars);
 
+	void Get_ValueVarList(LuaVarList &vars, LuaVarListMap &prefetched) const;
+	void Set_ValueVarList(const LuaVarList &vars, const LuaVarListMap &prefetched);
+
 	void Get_ValueVar(LuaVar &var) const;
 	void Set_ValueVar(const LuaVar &var);
 
 	void Get_ValueBacktraceList(LuaBacktraceList &backtraces) const;
 	void Set_ValueBacktraceList(const LuaBacktraceList &backtraces);
 
+	void Get_ValueLineHeats(int &generation, LuaLineHeatsMap &heats) const;
+	void Set_ValueLineHeats(int generation, const LuaLineHeatsMap &heats);
+
 private:
 	container_type m_data;
 };
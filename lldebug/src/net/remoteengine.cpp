@@ -305,22 +305,27 @@ void RemoteEngine::SendChangedState(bool isBreak) {
 		data);
 }
 
-void RemoteEngine::SendUpdateSource(const std::string &key, int line,
+void RemoteEngine::SendUpdateSource(int sourceId, int line,
 									int updateSourceCount, bool isRefreshOnly,
+									const LuaWatchResults &watches,
 									const CommandCallback &response) {
 	CommandData data;
 
-	data.Set_UpdateSource(key, line, updateSourceCount, isRefreshOnly);
+	data.Set_UpdateSource(sourceId, line, updateSourceCount,
+		isRefreshOnly, watches);
 	SendCommand(
 		REMOTECOMMANDTYPE_UPDATE_SOURCE,
 		data,
 		response);
 }
 
-void RemoteEngine::SendForceUpdateSource() {
+void RemoteEngine::SendForceUpdateSource(bool withWatches) {
+	CommandData data;
+
+	data.Set_ForceUpdateSource(withWatches);
 	SendCommand(
 		REMOTECOMMANDTYPE_FORCE_UPDATESOURCE,
-		CommandData());
+		data);
 }
 
 void RemoteEngine::SendAddedSource(const Source &source) {
@@ -332,11 +337,11 @@ void RemoteEngine::SendAddedSource(const Source &source) {
 		data);
 }
 
-void RemoteEngine::SendSaveSource(const std::string &key,
+void RemoteEngine::SendSaveSource(int sourceId,
 								  const string_array &sources) {
 	CommandData data;
 
-	data.Set_SaveSource(key, sources);
+	data.Set_SaveSource(sourceId, sources);
 	SendCommand(
 		REMOTECOMMANDTYPE_SAVE_SOURCE,
 		data);
@@ -446,6 +451,25 @@ struct LuaVarListResponseHandler {
 	}
 };
 
+/**
+ * @brief Handle the response VarList with the prefetched fields.
+ */
+struct LuaPrefetchedVarListResponseHandler {
+	LuaPrefetchedVarListCallback m_callback;
+
+	explicit LuaPrefetchedVarListResponseHandler(
+		const LuaPrefetchedVarListCallback &callback)
+		: m_callback(callback) {
+	}
+
+	int operator()(const Command &command) {
+		LuaVarList vars;
+		LuaVarListMap prefetched;
+		command.GetData().Get_ValueVarList(vars, prefetched);
+		return m_callback(command, vars, prefetched);
+	}
+};
+
 /**
  * @brief Handle the response VarList.
  */
@@ -465,10 +489,11 @@ struct LuaVarResponseHandler {
 
 void RemoteEngine::SendEvalsToVarList(const string_array &evals,
 									  const LuaStackFrame &stackFrame,
+									  const LuaEvalBudget &budget,
 									  const LuaVarListCallback &callback) {
 	CommandData data;
 
-	data.Set_EvalsToVarList(evals, stackFrame);
+	data.Set_EvalsToVarList(evals, stackFrame, budget);
 	SendCommand(
 		REMOTECOMMANDTYPE_EVALS_TO_VARLIST,
 		data,
@@ -477,10 +502,11 @@ void RemoteEngine::SendEvalsToVarList(const string_array &evals,
 
 void RemoteEngine::SendEvalToMultiVar(const std::string &eval,
 									  const LuaStackFrame &stackFrame,
+									  const LuaEvalBudget &budget,
 									  const LuaVarListCallback &callback) {
 	CommandData data;
 
-	data.Set_EvalToMultiVar(eval, stackFrame);
+	data.Set_EvalToMultiVar(eval, stackFrame, budget);
 	SendCommand(
 		REMOTECOMMANDTYPE_EVAL_TO_MULTIVAR,
 		data,
@@ -489,52 +515,113 @@ void RemoteEngine::SendEvalToMultiVar(const std::string &eval,
 
 void RemoteEngine::SendEvalToVar(const std::string &eval,
 								 const LuaStackFrame &stackFrame,
+								 const LuaEvalBudget &budget,
 								 const LuaVarCallback &callback) {
 	CommandData data;
 
-	data.Set_EvalToVar(eval, stackFrame);
+	data.Set_EvalToVar(eval, stackFrame, budget);
 	SendCommand(
 		REMOTECOMMANDTYPE_EVAL_TO_VAR,
 		data,
 		LuaVarResponseHandler(callback));
 }
 
-void RemoteEngine::SendRequestFieldsVarList(const LuaVar &var,
+void RemoteEngine::SendAddWatch(int watchId, const std::string &eval) {
+	CommandData data;
+
+	data.Set_AddWatch(watchId, eval);
+	SendCommand(
+		REMOTECOMMANDTYPE_ADD_WATCH,
+		data);
+}
+
+void RemoteEngine::SendRemoveWatch(int watchId) {
+	CommandData data;
+
+	data.Set_RemoveWatch(watchId);
+	SendCommand(
+		REMOTECOMMANDTYPE_REMOVE_WATCH,
+		data);
+}
+
+void RemoteEngine::SendStartProfiler(lldebug_ProfileMode mode, int interval) {
+	CommandData data;
+
+	data.Set_StartProfiler(mode, interval);
+	SendCommand(
+		REMOTECOMMANDTYPE_START_PROFILER,
+		data);
+}
+
+void RemoteEngine::SendStopProfiler() {
+	SendCommand(
+		REMOTECOMMANDTYPE_STOP_PROFILER,
+		CommandData());
+}
+
+void RemoteEngine::SendRequestFieldsVarList(const LuaVarRef &ref,
+											int updateCount,
+											const LuaVarFilter &filter,
 											const LuaVarListCallback &callback) {
 	CommandData data;
 
-	data.Set_RequestFieldVarList(var);
+	data.Set_RequestFieldVarList(ref, updateCount, filter, 0, 0);
 	SendCommand(
 		REMOTECOMMANDTYPE_REQUEST_FIELDSVARLIST,
 		data,
 		LuaVarListResponseHandler(callback));
 }
 
+void RemoteEngine::SendRequestFieldsVarList(const LuaVarRef &ref,
+											int updateCount,
+											const LuaVarFilter &filter,
+											int prefetchBytes,
+											int prefetchDepth,
+											const LuaPrefetchedVarListCallback &callback) {
+	CommandData data;
+
+	data.Set_RequestFieldVarList(ref, updateCount, filter,
+								 prefetchBytes, prefetchDepth);
+	SendCommand(
+		REMOTECOMMANDTYPE_REQUEST_FIELDSVARLIST,
+		data,
+		LuaPrefetchedVarListResponseHandler(callback));
+}
+
 void RemoteEngine::SendRequestLocalVarList(const LuaStackFrame &stackFrame,
 										   bool checkLocal, bool checkUpvalue,
 										   bool checkEnviron,
+										   const LuaVarFilter &filter,
 										   const LuaVarListCallback &callback) {
 	CommandData data;
 
 	data.Set_RequestLocalVarList(
-		stackFrame, checkLocal,checkUpvalue, checkEnviron);
+		stackFrame, checkLocal,checkUpvalue, checkEnviron, filter);
 	SendCommand(
 		REMOTECOMMANDTYPE_REQUEST_LOCALVARLIST,
 		data,
 		LuaVarListResponseHandler(callback));
 }
 
-void RemoteEngine::SendRequestGlobalVarList(const LuaVarListCallback &callback) {
+void RemoteEngine::SendRequestGlobalVarList(const LuaVarFilter &filter,
+											const LuaVarListCallback &callback) {
+	CommandData data;
+
+	data.Set_RequestGlobalVarList(filter);
 	SendCommand(
 		REMOTECOMMANDTYPE_REQUEST_GLOBALVARLIST,
-		CommandData(),
+		data,
 		LuaVarListResponseHandler(callback));
 }
 
-void RemoteEngine::SendRequestRegistryVarList(const LuaVarListCallback &callback) {
+void RemoteEngine::SendRequestRegistryVarList(const LuaVarFilter &filter,
+											  const LuaVarListCallback &callback) {
+	CommandData data;
+
+	data.Set_RequestRegistryVarList(filter);
 	SendCommand(
 		REMOTECOMMANDTYPE_REQUEST_REGISTRYVARLIST,
-		CommandData(),
+		data,
 		LuaVarListResponseHandler(callback));
 }
 
@@ -562,11 +649,11 @@ struct SourceResponseHandler {
 	}
 };
 
-void RemoteEngine::SendRequestSource(const std::string &key,
+void RemoteEngine::SendRequestSource(int sourceId,
 									 const SourceCallback &callback) {
 	CommandData data;
 
-	data.Set_RequestSource(key);
+	data.Set_RequestSource(sourceId);
 	SendCommand(
 		REMOTECOMMANDTYPE_REQUEST_SOURCE,
 		data,
@@ -597,6 +684,75 @@ void RemoteEngine::SendRequestBacktraceList(const LuaBacktraceListCallback &call
 		BacktraceListHandler(callback));
 }
 
+/**
+ * @brief Handle the response string.
+ */
+struct StringResponseHandler {
+	StringCallback m_callback;
+
+	explicit StringResponseHandler(const StringCallback &callback)
+		: m_callback(callback) {
+	}
+
+	int operator()(const Command &command) {
+		std::string str;
+		command.GetData().Get_ValueString(str);
+		return m_callback(command, str);
+	}
+};
+
+void RemoteEngine::SendRequestVarValue(const LuaVarRef &ref, int updateCount,
+									   int offset, int length,
+									   const StringCallback &callback) {
+	CommandData data;
+
+	data.Set_RequestVarValue(ref, updateCount, offset, length);
+	SendCommand(
+		REMOTECOMMANDTYPE_REQUEST_VARVALUE,
+		data,
+		StringResponseHandler(callback));
+}
+
+void RemoteEngine::SendRequestProfile(lldebug_ProfileFormat format,
+									  const StringCallback &callback) {
+	CommandData data;
+
+	data.Set_RequestProfile(format);
+	SendCommand(
+		REMOTECOMMANDTYPE_REQUEST_PROFILE,
+		data,
+		StringResponseHandler(callback));
+}
+
+/**
+ * @brief Handle the response LineHeats.
+ */
+struct LuaLineHeatsResponseHandler {
+	LuaLineHeatsCallback m_callback;
+
+	explicit LuaLineHeatsResponseHandler(const LuaLineHeatsCallback &callback)
+		: m_callback(callback) {
+	}
+
+	int operator()(const Command &command) {
+		int generation;
+		LuaLineHeatsMap heats;
+		command.GetData().Get_ValueLineHeats(generation, heats);
+		return m_callback(command, generation, heats);
+	}
+};
+
+void RemoteEngine::SendRequestLineHeats(const std::vector<int> &sourceIds,
+										const LuaLineHeatsCallback &callback) {
+	CommandData data;
+
+	data.Set_RequestLineHeats(sourceIds);
+	SendCommand(
+		REMOTECOMMANDTYPE_REQUEST_LINEHEATS,
+		data,
+		LuaLineHeatsResponseHandler(callback));
+}
+
 
 void RemoteEngine::ResponseSuccessed(const Command &command) {
 	ResponseCommand(
@@ -643,6 +799,29 @@ void RemoteEngine::ResponseVarList(const Command &command,
 		data);
 }
 
+void RemoteEngine::ResponseVarList(const Command &command,
+								   const LuaVarList &vars,
+								   const LuaVarListMap &prefetched) {
+	CommandData data;
+
+	data.Set_ValueVarList(vars, prefetched);
+	ResponseCommand(
+		command,
+		REMOTECOMMANDTYPE_VALUE_VARLIST,
+		data);
+}
+
+void RemoteEngine::ResponseLineHeats(const Command &command, int generation,
+									 const LuaLineHeatsMap &heats) {
+	CommandData data;
+
+	data.Set_ValueLineHeats(generation, heats);
+	ResponseCommand(
+		command,
+		REMOTECOMMANDTYPE_VALUE_LINEHEATS,
+		data);
+}
+
 void RemoteEngine::ResponseVar(const Command &command, const LuaVar &var) {
 	CommandData data;
 
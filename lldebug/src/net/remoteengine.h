@@ -50,12 +50,18 @@ typedef
 typedef
 	boost::function2<int, const Command &, const LuaVarList &>
 	LuaVarListCallback;
+typedef
+	boost::function3<int, const Command &, const LuaVarList &, const LuaVarListMap &>
+	LuaPrefetchedVarListCallback;
 typedef
 	boost::function2<int, const Command &, const LuaVar &>
 	LuaVarCallback;
 typedef
 	boost::function2<int, const Command &, const LuaBacktraceList &>
 	LuaBacktraceListCallback;
+typedef
+	boost::function3<int, const Command &, int, const LuaLineHeatsMap &>
+	LuaLineHeatsCallback;
 
 /**
  * @brief Remote engine for debugger.
@@ -105,11 +111,12 @@ public:
 	void OutputLog(LogType type, const std::string &msg);
 
 	void SendChangedState(bool isBreak);
-	void SendUpdateSource(const std::string &key, int line, int updateCount,
-						  bool isRefreshOnly, const CommandCallback &response);
-	void SendForceUpdateSource();
+	void SendUpdateSource(int sourceId, int line, int updateCount,
+						  bool isRefreshOnly, const LuaWatchResults &watches,
+						  const CommandCallback &response);
+	void SendForceUpdateSource(bool withWatches);
 	void SendAddedSource(const Source &source);
-	void SendSaveSource(const std::string &key, const string_array &sources);
+	void SendSaveSource(int sourceId, const string_array &sources);
 	void SendSetUpdateCount(int updateCount);
 
 	void SendSetBreakpoint(const Breakpoint &bp);
@@ -125,21 +132,45 @@ public:
 	void SendSetEncoding(lldebug_Encoding encoding);
 	void SendOutputLog(const LogData &logData);
 	void SendEvalsToVarList(const string_array &eval, const LuaStackFrame &stackFrame,
+							const LuaEvalBudget &budget,
 							const LuaVarListCallback &callback);
 	void SendEvalToMultiVar(const std::string &eval, const LuaStackFrame &stackFrame,
+							const LuaEvalBudget &budget,
 							const LuaVarListCallback &callback);
 	void SendEvalToVar(const std::string &eval, const LuaStackFrame &stackFrame,
+					   const LuaEvalBudget &budget,
 					   const LuaVarCallback &callback);
+	void SendAddWatch(int watchId, const std::string &eval);
+	void SendRemoveWatch(int watchId);
+
+	void SendStartProfiler(lldebug_ProfileMode mode, int interval);
+	void SendStopProfiler();
+	void SendRequestProfile(lldebug_ProfileFormat format,
+							const StringCallback &callback);
+	void SendRequestLineHeats(const std::vector<int> &sourceIds,
+							  const LuaLineHeatsCallback &callback);
 	
-	void SendRequestFieldsVarList(const LuaVar &var, const LuaVarListCallback &callback);
+	void SendRequestFieldsVarList(const LuaVarRef &ref, int updateCount,
+								  const LuaVarFilter &filter,
+								  const LuaVarListCallback &callback);
+	void SendRequestFieldsVarList(const LuaVarRef &ref, int updateCount,
+								  const LuaVarFilter &filter,
+								  int prefetchBytes, int prefetchDepth,
+								  const LuaPrefetchedVarListCallback &callback);
 	void SendRequestLocalVarList(const LuaStackFrame &stackFrame, bool checkLocal,
 								 bool checkUpvalue, bool checkEnviron,
+								 const LuaVarFilter &filter,
 								 const LuaVarListCallback &callback);
-	void SendRequestGlobalVarList(const LuaVarListCallback &callback);
-	void SendRequestRegistryVarList(const LuaVarListCallback &callback);
+	void SendRequestGlobalVarList(const LuaVarFilter &filter,
+								  const LuaVarListCallback &callback);
+	void SendRequestRegistryVarList(const LuaVarFilter &filter,
+									const LuaVarListCallback &callback);
 	void SendRequestStackList(const LuaVarListCallback &callback);
-	void SendRequestSource(const std::string &key, const SourceCallback &callback);
+	void SendRequestSource(int sourceId, const SourceCallback &callback);
 	void SendRequestBacktraceList(const LuaBacktraceListCallback &callback);
+	void SendRequestVarValue(const LuaVarRef &ref, int updateCount,
+							 int offset, int length,
+							 const StringCallback &callback);
 
 	void ResponseSuccessed(const Command &command);
 	void ResponseFailed(const Command &command);
@@ -147,6 +178,10 @@ public:
 	void ResponseSource(const Command &command, const Source &source);
 	void ResponseBacktraceList(const Command &command, const LuaBacktraceList &backtraces);
 	void ResponseVarList(const Command &command, const LuaVarList &vars);
+	void ResponseLineHeats(const Command &command, int generation,
+						   const LuaLineHeatsMap &heats);
+	void ResponseVarList(const Command &command, const LuaVarList &vars,
+						 const LuaVarListMap &prefetched);
 	void ResponseVar(const Command &command, const LuaVar &var);
 
 private:
@@ -155,12 +155,13 @@ void BreakpointList::Toggle(const std::string &key, int line) {
 
 
 /*-----------------------------------------------------------------*/
-Source::Source(const std::string &key, const std::string &title,
+Source::Source(int id, const std::string &key, const std::string &title,
 			   const string_array &sources, const std::string &path)
-	: m_key(key), m_title(title), m_path(path), m_sources(sources) {
+	: m_id(id), m_key(key), m_title(title), m_path(path), m_sources(sources) {
 }
 
-Source::Source() {
+Source::Source()
+	: m_id(-1) {
 }
 
 Source::~Source() {
@@ -169,7 +170,7 @@ Source::~Source() {
 
 /*-----------------------------------------------------------------*/
 SourceManager::SourceManager(shared_ptr<RemoteEngine> engine)
-	: m_engine(engine), m_textCounter(0) {
+	: m_engine(engine), m_idCounter(0), m_textCounter(0) {
 	assert(engine != NULL);
 }
 
@@ -188,7 +189,16 @@ std::list<Source> SourceManager::GetList() {
 }
 
 const Source *SourceManager::Get(const std::string &key) {
-	ImplMap::iterator it = m_sourceMap.find(key);
+	KeyMap::iterator it = m_keyMap.find(key);
+	if (it == m_keyMap.end()) {
+		return NULL;
+	}
+
+	return Get(it->second);
+}
+
+const Source *SourceManager::Get(int id) {
+	ImplMap::iterator it = m_sourceMap.find(id);
 	if (it == m_sourceMap.end()) {
 		return NULL;
 	}
@@ -210,7 +220,8 @@ const Source *SourceManager::GetString(const std::string &key) {
 }
 
 int SourceManager::AddSource(const Source &source, bool sendRemote) {
-	m_sourceMap.insert(std::make_pair(source.GetKey(), source));
+	m_sourceMap.insert(std::make_pair(source.GetId(), source));
+	m_keyMap.insert(std::make_pair(source.GetKey(), source.GetId()));
 
 	(void)sendRemote;
 
@@ -243,7 +254,7 @@ int SourceManager::Add(const std::string &key, const std::string &src) {
 		return -1;
 	}
 
-	if (m_sourceMap.find(key) != m_sourceMap.end()) {
+	if (m_keyMap.find(key) != m_keyMap.end()) {
 		return 0;
 	}
 
@@ -260,7 +271,7 @@ int SourceManager::Add(const std::string &key, const std::string &src) {
 			return -1;
 		}
 
-		AddSource(Source(key, path.leaf(), split(ifs), pathstr), true);
+		AddSource(Source(m_idCounter++, key, path.leaf(), split(ifs), pathstr), true);
 	}
 	else {
 		// We make the original source title and don't use the key,
@@ -270,15 +281,15 @@ int SourceManager::Add(const std::string &key, const std::string &src) {
 		title.flush();
 
 		std::stringstream sstream(src);
-		AddSource(Source(key, title.str(), split(sstream)), true);
+		AddSource(Source(m_idCounter++, key, title.str(), split(sstream)), true);
 	}
 	
 	return 0;
 }
 
-int SourceManager::Save(const std::string &key, const string_array &source) {
-	// Find the source from key.
-	ImplMap::iterator it = m_sourceMap.find(key);
+int SourceManager::Save(int id, const string_array &source) {
+	// Find the source from id.
+	ImplMap::iterator it = m_sourceMap.find(id);
 	if (it == m_sourceMap.end()) {
 		return -1;
 	}
@@ -63,13 +63,14 @@ enum LogType {
 class LogData {
 public:
 	explicit LogData(LogType type, const std::string &msg,
-					 const std::string &key=std::string(""), int line=-1)
+					 const std::string &key=std::string(""), int line=-1,
+					 int sourceId=-1)
 		: m_type(type), m_message(msg), m_key(key), m_line(line)
-		, m_isRemote(false) {
+		, m_sourceId(sourceId), m_isRemote(false) {
 	}
 
 	explicit LogData()
-		: m_type(LOGTYPE_MESSAGE), m_line(-1)
+		: m_type(LOGTYPE_MESSAGE), m_line(-1), m_sourceId(-1)
 		, m_isRemote(false) {
 	}
 
@@ -87,6 +88,7 @@ public:
 	}
 
 	/// Get the source key that is associated with 'Source' class. It may be invalid.
+	/// The key isn't sent through the network, so use 'GetSourceId' on the other side.
 	const std::string &GetKey() const {
 		return m_key;
 	}
@@ -96,6 +98,11 @@ public:
 		return m_line;
 	}
 
+	/// Get the source id that is associated with 'Source' class. It may be invalid.
+	int GetSourceId() const {
+		return m_sourceId;
+	}
+
 	/// Was this log sent through the network ?
 	bool IsRemote() const {
 		return m_isRemote;
@@ -112,8 +119,8 @@ private:
 	void serialize(Archive& ar, const unsigned int) {
 		ar & LLDEBUG_MEMBER_NVP(type);
 		ar & LLDEBUG_MEMBER_NVP(message);
-		ar & LLDEBUG_MEMBER_NVP(key);
 		ar & LLDEBUG_MEMBER_NVP(line);
+		ar & LLDEBUG_MEMBER_NVP(sourceId);
 		ar & LLDEBUG_MEMBER_NVP(isRemote);
 	}
 
@@ -122,6 +129,7 @@ private:
 	std::string m_message;
 	std::string m_key;
 	int m_line;
+	int m_sourceId;
 	bool m_isRemote;
 };
 
@@ -226,13 +234,19 @@ private:
  */
 class Source {
 public:
-	explicit Source(const std::string &key,
+	explicit Source(int id,
+					const std::string &key,
 					const std::string &title,
 					const string_array &sources,
 					const std::string &path = std::string(""));
 	explicit Source();
 	~Source();
 
+	/// Get the interned id of the source key, which is used on the network.
+	int GetId() const {
+		return m_id;
+	}
+
 	/// Get the source identifier.
 	const std::string &GetKey() const {
 		return m_key;
@@ -267,6 +281,7 @@ private:
 	friend class boost::serialization::access;
 	template<class Archive>
 	void serialize(Archive& ar, const unsigned int) {
+		ar & LLDEBUG_MEMBER_NVP(id);
 		ar & LLDEBUG_MEMBER_NVP(key);
 		ar & LLDEBUG_MEMBER_NVP(title);
 		ar & LLDEBUG_MEMBER_NVP(path);
@@ -274,6 +289,7 @@ private:
 	}
 
 private:
+	int m_id;
 	std::string m_key;
 	std::string m_title;
 	std::string m_path;
@@ -282,6 +298,9 @@ private:
 
 /**
  * @brief The manager of the source files displayed when debugging.
+ *
+ * Each source key is interned into a small integer id when the source
+ * is added, and only the id is used in the network commands after that.
  */
 class SourceManager {
 public:
@@ -291,6 +310,9 @@ public:
 	/// Get the source infomation from key.
 	const Source *Get(const std::string &key);
 
+	/// Get the source infomation from the source id.
+	const Source *Get(int id);
+
 	/// Get the string source by the first part of the key.
 	const Source *GetString(const std::string &key);
 
@@ -304,13 +326,16 @@ public:
 	int Add(const std::string &key, const std::string &src);
 
 	/// Save a source.
-	int Save(const std::string &key, const string_array &source);
+	int Save(int id, const string_array &source);
 
 private:
 	weak_ptr<RemoteEngine> m_engine;
 
-	typedef std::map<std::string, Source> ImplMap;
+	typedef std::map<int, Source> ImplMap;
 	ImplMap m_sourceMap;
+	typedef std::map<std::string, int> KeyMap;
+	KeyMap m_keyMap;
+	int m_idCounter;
 	int m_textCounter;
 };
 
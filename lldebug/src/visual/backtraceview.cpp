@@ -132,7 +132,7 @@ bool BacktraceView::IsSameContents(const LuaBacktraceList &backtraces) {
 		const LuaBacktrace &bt2 = GetItemData(children[i])->GetBacktrace();
 
 		if (bt1.GetFuncName() != bt2.GetFuncName()
-			|| bt1.GetKey() != bt2.GetKey() || bt1.GetLine() != bt1.GetLine()
+			|| bt1.GetSourceId() != bt2.GetSourceId() || bt1.GetLine() != bt1.GetLine()
 			|| bt1.GetLua() != bt2.GetLua() || bt1.GetLevel() != bt2.GetLevel()) {
 			return false;
 		}
@@ -158,11 +158,13 @@ void BacktraceView::DoUpdate(const LuaBacktraceList &backtraces) {
 			new BacktraceViewItemData(backtrace));
 
 		// Set texts of columns.
-		if (backtrace.GetTitle().empty()) {
+		const Source *source =
+			Mediator::Get()->GetSource(backtrace.GetSourceId());
+		if (source == NULL) {
 			SetItemText(item, 0, wxT("unknown"));
 		}
 		else {
-			SetItemText(item, 0, wxConvFromCtxEnc(backtrace.GetTitle()));
+			SetItemText(item, 0, wxConvFromCtxEnc(source->GetTitle()));
 		}
 		SetItemText(item, 1,
 			wxString::Format(wxT("%d"), backtrace.GetLine()));
@@ -80,17 +80,17 @@ public:
 
 	/// UpdateSource event
 	explicit wxDebugEvent(wxEventType type, int winid,
-						  const std::string &key, int line,
+						  int sourceId, int line,
 						  int updateCount, bool isRefreshOnly)
-		: wxEvent(winid, type), m_key(key), m_line(line)
+		: wxEvent(winid, type), m_sourceId(sourceId), m_line(line)
 		, m_updateCount(updateCount), m_isRefreshOnly(isRefreshOnly) {
 		wxASSERT(type == wxEVT_DEBUG_UPDATE_SOURCE);
 	}
 
 	/// FocusErrorLine event
 	explicit wxDebugEvent(wxEventType type, int winid,
-						  const std::string &key, int line)
-		: wxEvent(winid, type), m_key(key), m_line(line) {
+						  int sourceId, int line)
+		: wxEvent(winid, type), m_sourceId(sourceId), m_line(line) {
 		wxASSERT(type == wxEVT_DEBUG_FOCUS_ERRORLINE);
 	}
 
@@ -98,7 +98,7 @@ public:
 	explicit wxDebugEvent(wxEventType type, int winid,
 						  const LuaBacktrace &bt)
 		: wxEvent(winid, type), m_backtrace(bt)
-		, m_key(bt.GetKey()), m_line(bt.GetLine()) {
+		, m_sourceId(bt.GetSourceId()), m_line(bt.GetLine()) {
 		wxASSERT(type == wxEVT_DEBUG_FOCUS_BACKTRACELINE);
 	}
 
@@ -111,7 +111,7 @@ public:
 
 	/// OutputLog event
 	explicit wxDebugEvent(wxEventType type, int winid, const LogData &logData)
-		: wxEvent(winid, type), m_key(logData.GetKey())
+		: wxEvent(winid, type), m_sourceId(logData.GetSourceId())
 		, m_line(logData.GetLine()), m_logData(logData) {
 		wxASSERT(type == wxEVT_DEBUG_OUTPUT_LOG);
 	}
@@ -133,9 +133,9 @@ public:
 		return m_backtrace;
 	}
 
-	/// Get identifier key of the source file.
-	const std::string &GetKey() const {
-		return m_key;
+	/// Get the interned id of the source file.
+	int GetSourceId() const {
+		return m_sourceId;
 	}
 
 	/// Get the number of line.
@@ -166,7 +166,7 @@ public:
 private:
 	Source m_source;
 	LuaBacktrace m_backtrace;
-	std::string m_key;
+	int m_sourceId;
 	int m_line;
 	LogData m_logData;
 	int m_updateCount;
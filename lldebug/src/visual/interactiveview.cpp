@@ -290,7 +290,10 @@ struct EvalResponseHandler {
 		}
 
 		// Increment update count for WatchView and other, if need.
-		Mediator::Get()->GetEngine()->SendForceUpdateSource();
+		// The watches are evaluated only for the top of the stack,
+		// they are thrown away for the other stack frame.
+		Mediator::Get()->GetEngine()->SendForceUpdateSource(
+			Mediator::Get()->IsTopFrame());
 		return 0;
 	}
 	};
@@ -321,9 +324,12 @@ void InteractiveView::Run() {
 	}
 
 	// Eval the string.
+	// The typed code may run long on purpose,
+	// so only the time is limited loosely.
 	Mediator::Get()->GetEngine()->SendEvalToMultiVar(
 		evalstr,
 		Mediator::Get()->GetStackFrame(),
+		LuaEvalBudget(-1, 30 * 1000),
 		EvalResponseHandler(this, isVar));
 
 	// Show evaled text.
@@ -33,6 +33,8 @@
 #include "visual/watchview.h"
 #include "visual/backtraceview.h"
 
+#include "wx/file.h"
+
 namespace lldebug {
 namespace visual {
 
@@ -44,6 +46,13 @@ enum {
 	ID_MENU_STEPRETURN,
 	ID_MENU_TOGGLE_BREAKPOINT,
 
+	ID_MENU_START_PROFILER,
+	ID_MENU_START_TRACER,
+	ID_MENU_START_COUNTER,
+	ID_MENU_STOP_PROFILER,
+	ID_MENU_SAVE_PROFILE,
+	ID_MENU_SHOW_HEATMAP,
+
 	ID_MENU_SHOW_LOCALWATCH,
 	ID_MENU_SHOW_GLOBALWATCH,
 	ID_MENU_SHOW_REGISTRYWATCH,
@@ -66,6 +75,13 @@ BEGIN_EVENT_TABLE(MainFrame, wxFrame)
 	EVT_MENU(ID_MENU_STEPRETURN, MainFrame::OnMenu)
 	EVT_MENU(ID_MENU_TOGGLE_BREAKPOINT, MainFrame::OnMenu)
 
+	EVT_MENU(ID_MENU_START_PROFILER, MainFrame::OnMenu)
+	EVT_MENU(ID_MENU_START_TRACER, MainFrame::OnMenu)
+	EVT_MENU(ID_MENU_START_COUNTER, MainFrame::OnMenu)
+	EVT_MENU(ID_MENU_STOP_PROFILER, MainFrame::OnMenu)
+	EVT_MENU(ID_MENU_SAVE_PROFILE, MainFrame::OnMenu)
+	EVT_MENU(ID_MENU_SHOW_HEATMAP, MainFrame::OnMenu)
+
 	EVT_MENU(ID_MENU_SHOW_LOCALWATCH, MainFrame::OnMenu)
 	EVT_MENU(ID_MENU_SHOW_GLOBALWATCH, MainFrame::OnMenu)
 	EVT_MENU(ID_MENU_SHOW_REGISTRYWATCH, MainFrame::OnMenu)
@@ -140,10 +156,20 @@ void MainFrame::CreateGUIControls() {
 	debugMenu->AppendSeparator();
 	debugMenu->Append(ID_MENU_TOGGLE_BREAKPOINT, _("&Toggle Breakpoint\tF9"));
 
+	wxMenu *profileMenu = new wxMenu;
+	profileMenu->Append(ID_MENU_START_PROFILER, _("&Start Sampling"));
+	profileMenu->Append(ID_MENU_START_TRACER, _("Start T&racing"));
+	profileMenu->Append(ID_MENU_START_COUNTER, _("Start &Counting Instructions"));
+	profileMenu->Append(ID_MENU_STOP_PROFILER, _("S&top Profiler"));
+	profileMenu->AppendSeparator();
+	profileMenu->Append(ID_MENU_SAVE_PROFILE, _("Save &Profile..."));
+	profileMenu->AppendCheckItem(ID_MENU_SHOW_HEATMAP, _("Show &Heatmap"));
+
 	wxMenuBar *menuBar = new wxMenuBar(wxMB_DOCKABLE);
 	menuBar->Append(fileMenu, _("&File"));
 	menuBar->Append(viewMenu, _("&View"));
 	menuBar->Append(debugMenu, _("&Debug"));
+	menuBar->Append(profileMenu, _("&Profile"));
 	SetMenuBar(menuBar);
 
 	CreateStatusBar(2, wxNO_BORDER);
@@ -275,6 +301,29 @@ void MainFrame::ShowDebugWindow(int wintypeid) {
 	}
 }
 
+/**
+ * @brief Write the profile got from the context to the file.
+ */
+struct SaveProfileCallback {
+	explicit SaveProfileCallback(const wxString &path)
+		: m_path(path) {
+	}
+	int operator()(const Command &/*command*/, const std::string &profile) {
+		wxFile file;
+
+		if (!file.Create(m_path, true)
+			|| !file.Write(profile.c_str(), profile.length())) {
+			Mediator::Get()->OutputLog(LOGTYPE_ERROR,
+				_("Couldn't write the profile to '") + m_path + wxT("'."));
+			return -1;
+		}
+
+		return 0;
+	}
+private:
+	wxString m_path;
+};
+
 void MainFrame::OnMenu(wxCommandEvent &event) {
 	switch (event.GetId()) {
 	case wxID_EXIT:
@@ -299,6 +348,44 @@ void MainFrame::OnMenu(wxCommandEvent &event) {
 		m_sourceView->ToggleBreakpoint();
 		break;
 
+	case ID_MENU_START_PROFILER:
+		Mediator::Get()->GetEngine()->SendStartProfiler(
+			LLDEBUG_PROFILEMODE_SAMPLING, LLDEBUG_DEFAULT_SAMPLEINTERVAL);
+		break;
+	case ID_MENU_START_TRACER:
+		Mediator::Get()->GetEngine()->SendStartProfiler(
+			LLDEBUG_PROFILEMODE_TRACING, 0);
+		break;
+	case ID_MENU_START_COUNTER:
+		Mediator::Get()->GetEngine()->SendStartProfiler(
+			LLDEBUG_PROFILEMODE_INSTRUCTIONS, 0);
+		break;
+	case ID_MENU_STOP_PROFILER:
+		Mediator::Get()->GetEngine()->SendStopProfiler();
+		break;
+	case ID_MENU_SAVE_PROFILE: {
+		// The order is the same as the filters.
+		static const lldebug_ProfileFormat s_formats[] = {
+			LLDEBUG_PROFILEFORMAT_CALLTREE,
+			LLDEBUG_PROFILEFORMAT_FUNCTIONS,
+			LLDEBUG_PROFILEFORMAT_CALLGRIND,
+			LLDEBUG_PROFILEFORMAT_FOLDED,
+		};
+		wxFileDialog dialog(this, _("Save Profile"),
+			wxEmptyString, wxT("profile.txt"),
+			_("Call tree (*.txt)|*.txt|Function table (*.txt)|*.txt|Callgrind (callgrind.out.*)|callgrind.out.*|Folded stacks (*.folded)|*.folded"),
+			wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+		if (dialog.ShowModal() == wxID_OK) {
+			Mediator::Get()->GetEngine()->SendRequestProfile(
+				s_formats[dialog.GetFilterIndex()],
+				SaveProfileCallback(dialog.GetPath()));
+		}
+		}
+		break;
+	case ID_MENU_SHOW_HEATMAP:
+		m_sourceView->ShowHeatmap(event.IsChecked());
+		break;
+
 	case ID_MENU_SHOW_LOCALWATCH:
 		ShowDebugWindow(ID_LOCALWATCHVIEW);
 		break;
@@ -39,7 +39,9 @@ Mediator *Mediator::ms_instance = NULL;
 Mediator::Mediator()
 	: m_engine(new RemoteEngine), m_frame(NULL)
 	, m_breakpoints(m_engine), m_sourceManager(m_engine)
-	, m_port(0), m_updateCount(0) {
+	, m_port(0), m_updateCount(0)
+	, m_watchIdCounter(0), m_watchUpdateCount(-1)
+	, m_varListCacheUpdateCount(-1) {
 
 	m_engine->SetOnRemoteCommand(
 		boost::bind1st(
@@ -71,10 +73,98 @@ void Mediator::IncUpdateCount() {
 	m_engine->SendSetUpdateCount(m_updateCount);
 }
 
-void Mediator::FocusErrorLine(const std::string &key, int line) {
+void Mediator::SetWatches(const string_array &evals) {
+	std::set<std::string> evalSet;
+	string_array::const_iterator it;
+
+	for (it = evals.begin(); it != evals.end(); ++it) {
+		if (it->empty()) {
+			continue;
+		}
+
+		evalSet.insert(*it);
+		if (m_watchIds.find(*it) == m_watchIds.end()) {
+			int watchId = ++m_watchIdCounter;
+			m_watchIds[*it] = watchId;
+			m_engine->SendAddWatch(watchId, *it);
+		}
+	}
+
+	std::map<std::string, int>::iterator idIt = m_watchIds.begin();
+	while (idIt != m_watchIds.end()) {
+		if (evalSet.find(idIt->first) == evalSet.end()) {
+			m_engine->SendRemoveWatch(idIt->second);
+			m_watchResults.erase(idIt->second);
+			m_watchIds.erase(idIt++);
+		}
+		else {
+			++idIt;
+		}
+	}
+}
+
+int Mediator::GetWatchResults(const string_array &evals, LuaVarList &vars) {
+	// The stack frame or the watches have been changed after the update.
+	if (m_watchUpdateCount != m_updateCount) {
+		return -1;
+	}
+
+	LuaVarList result;
+	string_array::const_iterator it;
+	for (it = evals.begin(); it != evals.end(); ++it) {
+		if (it->empty()) {
+			result.push_back(LuaVar());
+			continue;
+		}
+
+		std::map<std::string, int>::iterator idIt = m_watchIds.find(*it);
+		if (idIt == m_watchIds.end()) {
+			return -1;
+		}
+
+		LuaWatchResults::iterator resultIt = m_watchResults.find(idIt->second);
+		if (resultIt == m_watchResults.end()) {
+			return -1;
+		}
+
+		result.push_back(resultIt->second);
+	}
+
+	vars = result;
+	return 0;
+}
+
+void Mediator::CheckVarListCache() {
+	// All cached vars are old if the update count has been changed.
+	if (m_varListCacheUpdateCount != m_updateCount) {
+		m_varListCache.clear();
+		m_varListCacheUpdateCount = m_updateCount;
+	}
+}
+
+int Mediator::FindVarListCache(const VarListCacheKey &key, LuaVarList &vars) {
+	CheckVarListCache();
+
+	VarListCache::iterator it = m_varListCache.find(key);
+	if (it == m_varListCache.end()) {
+		return -1;
+	}
+
+	vars = it->second;
+	return 0;
+}
+
+void Mediator::SetVarListCache(const VarListCacheKey &key,
+							   const LuaVarList &vars) {
+	CheckVarListCache();
+
+	m_varListCache[key] = vars;
+}
+
+void Mediator::FocusErrorLine(int sourceId, int line) {
 	MainFrame *frame = GetFrame();
 
-	wxDebugEvent event(wxEVT_DEBUG_FOCUS_ERRORLINE, wxID_ANY, key, line);
+	wxDebugEvent event(wxEVT_DEBUG_FOCUS_ERRORLINE, wxID_ANY, sourceId, line);
 	frame->ProcessDebugEvent(event, frame, true);
 }
 
@@ -152,6 +242,11 @@ void Mediator::ProcessRemoteCommand(const Command &command) {
 		m_sourceManager = SourceManager(m_engine);
 		m_stackFrame = LuaStackFrame();
 		m_updateCount = 0;
+		m_watchIds.clear();
+		m_watchResults.clear();
+		m_watchUpdateCount = -1;
+		m_varListCache.clear();
+		m_varListCacheUpdateCount = -1;
 		if (frame != NULL) {
 			wxDebugEvent event(wxEVT_DEBUG_END_DEBUG, wxID_ANY);
 			frame->ProcessDebugEvent(event, frame, true);
@@ -193,11 +288,11 @@ void Mediator::ProcessRemoteCommand(const Command &command) {
 
 	case REMOTECOMMANDTYPE_UPDATE_SOURCE:
 		{
-			std::string key;
-			int line, updateCount;
+			int sourceId, line, updateCount;
 			bool isRefreshOnly;
+			LuaWatchResults watches;
 			command.GetData().Get_UpdateSource(
-				key, line, updateCount, isRefreshOnly);
+				sourceId, line, updateCount, isRefreshOnly, watches);
 
 			// Update info.
 			if (updateCount > m_updateCount) {
@@ -208,6 +303,12 @@ void Mediator::ProcessRemoteCommand(const Command &command) {
 				m_engine->SendSetUpdateCount(m_updateCount);
 			}
 
+			// The watches were evaluated at the top of the current stack,
+			// so they are wrong if the refresh keeps the other stack frame.
+			m_watchResults = watches;
+			m_watchUpdateCount =
+				(isRefreshOnly && !IsTopFrame() ? -1 : m_updateCount);
+
 			// If isRefreshOnly is true, don't change the stack frame.
 			if (!isRefreshOnly) {
 				m_stackFrame = LuaStackFrame(LuaHandle(), 0);
@@ -216,7 +317,7 @@ void Mediator::ProcessRemoteCommand(const Command &command) {
 			if (frame != NULL) {
 				wxDebugEvent event(
 					wxEVT_DEBUG_UPDATE_SOURCE, wxID_ANY,
-					key, line, updateCount, isRefreshOnly);
+					sourceId, line, updateCount, isRefreshOnly);
 				frame->ProcessDebugEvent(event, frame, true);
 				m_engine->ResponseSuccessed(command);
 			}
@@ -279,6 +380,12 @@ void Mediator::ProcessRemoteCommand(const Command &command) {
 	case REMOTECOMMANDTYPE_EVALS_TO_VARLIST:
 	case REMOTECOMMANDTYPE_EVAL_TO_MULTIVAR:
 	case REMOTECOMMANDTYPE_EVAL_TO_VAR:
+	case REMOTECOMMANDTYPE_ADD_WATCH:
+	case REMOTECOMMANDTYPE_REMOVE_WATCH:
+	case REMOTECOMMANDTYPE_START_PROFILER:
+	case REMOTECOMMANDTYPE_STOP_PROFILER:
+	case REMOTECOMMANDTYPE_REQUEST_PROFILE:
+	case REMOTECOMMANDTYPE_REQUEST_LINEHEATS:
 	case REMOTECOMMANDTYPE_REQUEST_LOCALVARLIST:
 	case REMOTECOMMANDTYPE_REQUEST_FIELDSVARLIST:
 	case REMOTECOMMANDTYPE_REQUEST_GLOBALVARLIST:
@@ -286,6 +393,7 @@ void Mediator::ProcessRemoteCommand(const Command &command) {
 	case REMOTECOMMANDTYPE_REQUEST_STACKLIST:
 	case REMOTECOMMANDTYPE_REQUEST_BACKTRACELIST:
 	case REMOTECOMMANDTYPE_REQUEST_SOURCE:
+	case REMOTECOMMANDTYPE_REQUEST_VARVALUE:
 	case REMOTECOMMANDTYPE_SUCCESSED:
 	case REMOTECOMMANDTYPE_FAILED:
 	case REMOTECOMMANDTYPE_VALUE_STRING:
@@ -294,6 +402,7 @@ void Mediator::ProcessRemoteCommand(const Command &command) {
 	case REMOTECOMMANDTYPE_VALUE_SOURCE:
 	case REMOTECOMMANDTYPE_VALUE_BREAKPOINTLIST:
 	case REMOTECOMMANDTYPE_VALUE_BACKTRACELIST:
+	case REMOTECOMMANDTYPE_VALUE_LINEHEATS:
 		BOOST_ASSERT(false && "Invalid remote command.");
 		break;
 	}
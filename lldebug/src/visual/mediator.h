@@ -39,6 +39,12 @@ namespace visual {
 class Application;
 class MainFrame;
 
+/// The key of the var list cached in the frame.
+/** It consists of the lua handle and the string that identifies
+ * the request, e.g. the table index or the expression with the stack level.
+ */
+typedef std::pair<LuaHandle, std::string> VarListCacheKey;
+
 /**
  * @brief ׂẴNXɋʂ̏ێ܂B
  */
@@ -56,7 +62,7 @@ public:
 	void IncUpdateCount();
 
 	/// Focus the error line.
-	void FocusErrorLine(const std::string &key, int line);
+	void FocusErrorLine(int sourceId, int line);
 
 	/// Focus the backtrace.
 	void FocusBacktraceLine(const LuaBacktrace &bt);
@@ -95,6 +101,11 @@ public:
 		return m_sourceManager.Get(key);
 	}
 
+	/// Get the source object from the source id.
+	const Source *GetSource(int sourceId) {
+		return m_sourceManager.Get(sourceId);
+	}
+
 	/// Find the breakpoint.
 	Breakpoint FindBreakpoint(const std::string &key, int line) {
 		return m_breakpoints.Find(key, line);
@@ -120,6 +131,12 @@ public:
 		return m_stackFrame;
 	}
 
+	/// Is the stack frame the top of the current stack ?
+	bool IsTopFrame() {
+		return (m_stackFrame.GetLevel() == 0
+			&& m_stackFrame.GetLua() == LuaHandle());
+	}
+
 	/// Set the stack frame for the local vars.
 	void SetStackFrame(const LuaStackFrame &stackFrame) {
 		m_stackFrame = stackFrame;
@@ -130,7 +147,28 @@ public:
 		return m_updateCount;
 	}
 
+	/// Register the watches to the context.
+	/** The new evals are added and the evals that aren't in 'evals'
+	 * are removed. The empty evals are ignored.
+	 */
+	void SetWatches(const string_array &evals);
+
+	/// Get the results of the watches evaluated with the last update.
+	/** It returns -1 if they are old or any of 'evals' isn't registered.
+	 */
+	int GetWatchResults(const string_array &evals, LuaVarList &vars);
+
+	/// Find the var list that was cached in the current update.
+	/** It returns -1 if there is no cached list.
+	 */
+	int FindVarListCache(const VarListCacheKey &key, LuaVarList &vars);
+
+	/// Cache the var list, it's valid until the update count is changed.
+	void SetVarListCache(const VarListCacheKey &key, const LuaVarList &vars);
+
 private:
+	void CheckVarListCache();
+
 	void OutputLogInternal(const LogData &logData, bool sendRemote);
 	void OnRemoteCommand(const Command &command);
 
@@ -157,6 +195,15 @@ private:
 
 	LuaStackFrame m_stackFrame;
 	int m_updateCount;
+
+	std::map<std::string, int> m_watchIds;
+	int m_watchIdCounter;
+	LuaWatchResults m_watchResults;
+	int m_watchUpdateCount;
+
+	typedef std::map<VarListCacheKey, LuaVarList> VarListCache;
+	VarListCache m_varListCache;
+	int m_varListCacheUpdateCount;
 };
 
 } // end of namespace visual
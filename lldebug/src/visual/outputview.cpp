@@ -41,10 +41,10 @@ private:
 	};
 
 	struct ViewData {
-		explicit ViewData(const std::string &key_=std::string(""), int line_=-1)
-			: key(key_), line(line_) {
+		explicit ViewData(int sourceId_=-1, int line_=-1)
+			: sourceId(sourceId_), line(line_) {
 		}
-		std::string key;
+		int sourceId;
 		int line;
 	};
 	typedef std::map<int, ViewData> DataMap;
@@ -109,9 +109,9 @@ public:
 			AddTextRaw("Frame: ");
 		}
 
-		const Source *source = Mediator::Get()->GetSource(logData.GetKey());
+		const Source *source = Mediator::Get()->GetSource(logData.GetSourceId());
 		if (source != NULL) {
-			ViewData viewData(logData.GetKey(), logData.GetLine());
+			ViewData viewData(logData.GetSourceId(), logData.GetLine());
 			m_dataMap[GetLineCount() - 1] = viewData;
 
 			if (logData.GetType() == LOGTYPE_ERROR) {
@@ -154,7 +154,7 @@ private:
 		DataMap::iterator it = m_dataMap.find(line);
 		if (it != m_dataMap.end()) {
 			const ViewData &data = it->second;
-			Mediator::Get()->FocusErrorLine(data.key, data.line);
+			Mediator::Get()->FocusErrorLine(data.sourceId, data.line);
 
 			SetSelection(
 				PositionFromLine(line),
@@ -193,7 +193,10 @@ void OutputView::OnSize(wxSizeEvent &/*event*/) {
 }
 
 void OutputView::OutputLog(LogType logType, const wxString &str, const std::string &key, int line) {
-	m_text->OutputLog(LogData(logType, wxConvToCtxEnc(str), key, line));
+	const Source *source = Mediator::Get()->GetSource(key);
+	int sourceId = (source != NULL ? source->GetId() : -1);
+
+	m_text->OutputLog(LogData(logType, wxConvToCtxEnc(str), key, line, sourceId));
 }
 
 void OutputView::OnOutputLog(wxDebugEvent &event) {
@@ -33,6 +33,14 @@
 
 #include "wx/wxscintilla.h"
 
+/// The interval(msec) of the heatmap requests.
+#ifndef LLDEBUG_HEAT_INTERVAL
+#define LLDEBUG_HEAT_INTERVAL 300
+#endif
+
+/// The number of the heat levels.
+#define LLDEBUG_HEAT_LEVELS 5
+
 namespace lldebug {
 namespace visual {
 
@@ -58,18 +66,20 @@ class SourceViewPage : public wxScintilla {
 		MARGIN_DEBUG = 1,
 		MARGIN_FOLDING = 2,
 		MARGIN_DIVIDER = 3,
+		MARGIN_HEAT = 4,
 
 		MARKNUM_BREAKPOINT = 1,
 		MARKNUM_RUNNING = 2,
 		MARKNUM_BACKTRACE = 3,
+		MARKNUM_HEAT_FIRST = 4, ///< the coolest level
 	};
 
 public:
 	explicit SourceViewPage(SourceView *parent)
 		: wxScintilla(parent, wxID_ANY)
 		, m_parent(parent), m_initialized(false), m_isModified(false)
-		, m_hasPath(false), m_currentLine(-1), m_markedLine(-1)
-		, m_watch(NULL) {
+		, m_sourceId(-1), m_hasPath(false), m_currentLine(-1), m_markedLine(-1)
+		, m_heatMax(0), m_watch(NULL) {
 		CreateGUIControls();
 	}
 
@@ -152,6 +162,13 @@ private:
 		SetMarginSensitive(MARGIN_DIVIDER, false);
 		SetMarginMask(MARGIN_DIVIDER, 0);
 
+		// Set the heatmap margin, it's shown when the heats are set.
+		SetMarginType(MARGIN_HEAT, wxSCI_MARGIN_SYMBOL);
+		SetMarginWidth(MARGIN_HEAT, 0);
+		SetMarginSensitive(MARGIN_HEAT, false);
+		SetMarginMask(MARGIN_HEAT,
+			((1 << LLDEBUG_HEAT_LEVELS) - 1) << MARKNUM_HEAT_FIRST);
+
 		// Set the folding margins.
 		SetMarginType(MARGIN_FOLDING, wxSCI_MARGIN_SYMBOL);
 		SetMarginMask(MARGIN_FOLDING, wxSCI_MASK_FOLDERS);
@@ -204,6 +221,31 @@ private:
 		MarkerDefine(MARKNUM_BACKTRACE, wxSCI_MARK_BACKGROUND);
 		MarkerSetForeground(MARKNUM_BACKTRACE, wxColour(_T("YELLOW")));
 		MarkerSetBackground(MARKNUM_BACKTRACE, wxColour(_T("GREEN")));
+
+		/// Set the markers of the heats from yellow to red.
+		for (int i = 0; i < LLDEBUG_HEAT_LEVELS; ++i) {
+			int green = 255 - 255 * i / (LLDEBUG_HEAT_LEVELS - 1);
+			MarkerDefine(MARKNUM_HEAT_FIRST + i, wxSCI_MARK_FULLRECT);
+			MarkerSetBackground(MARKNUM_HEAT_FIRST + i,
+				wxColour(255, (unsigned char)green, 0));
+		}
+	}
+
+	/// Get the marker of the heat, the hottest line is the last level.
+	int GetHeatMarker(int heat) const {
+		int level = (int)(((double)heat * LLDEBUG_HEAT_LEVELS - 1) / m_heatMax);
+		return (MARKNUM_HEAT_FIRST + median(level, 0, LLDEBUG_HEAT_LEVELS - 1));
+	}
+
+	/// Mark the heat of the line (lua line base).
+	void MarkHeat(int line, int heat) {
+		for (int i = 0; i < LLDEBUG_HEAT_LEVELS; ++i) {
+			MarkerDelete(line - 1, MARKNUM_HEAT_FIRST + i);
+		}
+
+		if (heat > 0) {
+			MarkerAdd(line - 1, GetHeatMarker(heat));
+		}
 	}
 
 	/// Fold the source, if any.
@@ -295,6 +337,14 @@ private:
 		}
 	}
 
+	void ShowWatch(const wxString &valName, const wxPoint &pos) {
+		CloseWatch();
+		m_watch = new OneVariableWatchView(
+			this, valName, pos, wxSize(100, 400));
+		m_watch->Show();
+	}
+
+	/// The value is taken from the cache of the current update if any.
 	void OnHotSpotClick(wxScintillaEvent &event) {
 		AutoCompCancel();
 		CallTipCancel();
@@ -302,13 +352,9 @@ private:
 		wxPoint clientPos = PointFromPosition(event.GetPosition());
 		wxPoint screenPos = ClientToScreen(clientPos);
 		int lineHeight = TextHeight(LineFromPosition(event.GetPosition()));
+		wxPoint pos(screenPos.x - 50, screenPos.y + lineHeight);
 
-		CloseWatch();
-		m_watch = new OneVariableWatchView(
-			this, event.GetText(),
-			wxPoint(screenPos.x - 50, screenPos.y + lineHeight), 
-			wxSize(100, 400));
-		m_watch->Show();
+		ShowWatch(event.GetText(), pos);
 	}
 
 	void OnLeftDown(wxMouseEvent &event) {
@@ -343,6 +389,11 @@ public:
 		return m_key;
 	}
 
+	/// Get the interned id of the source.
+	int GetSourceId() const {
+		return m_sourceId;
+	}
+
 	/// Get the source title.
 	const wxString &GetTitle() const {
 		return m_title;
@@ -367,6 +418,7 @@ public:
 		SetReadOnly(source.GetPath().empty());
 
 		// The title is converted to UTF8.
+		m_sourceId = source.GetId();
 		m_key = source.GetKey();
 		m_title = wxConvFromCtxEnc(source.GetTitle());
 		m_hasPath = (!source.GetPath().empty());
@@ -377,6 +429,48 @@ public:
 		OnChangedBreakpoints(event);
 	}
 
+	/// Show the heats of the lines.
+	/**
+	 * 'heats' are all the heats of this source and 'changed' are
+	 * the ones updated now. All the lines are marked again
+	 * if 'changed' is NULL or the hottest line is changed.
+	 */
+	void SetHeats(const LuaLineHeats &heats, const LuaLineHeats *changed) {
+		int heatMax = 0;
+		LuaLineHeats::const_iterator it;
+		for (it = heats.begin(); it != heats.end(); ++it) {
+			if (it->second > heatMax) {
+				heatMax = it->second;
+			}
+		}
+
+		if (changed == NULL || heatMax != m_heatMax) {
+			ClearHeats();
+			m_heatMax = heatMax;
+			changed = &heats;
+		}
+
+		if (!heats.empty()) {
+			SetMarginWidth(MARGIN_HEAT, 8);
+		}
+
+		for (it = changed->begin(); it != changed->end(); ++it) {
+			if (0 < it->first && it->first <= GetLineCount()) {
+				MarkHeat(it->first, it->second);
+			}
+		}
+	}
+
+	/// Hide the heats of the lines.
+	void ClearHeats() {
+		for (int i = 0; i < LLDEBUG_HEAT_LEVELS; ++i) {
+			MarkerDeleteAll(MARKNUM_HEAT_FIRST + i);
+		}
+
+		SetMarginWidth(MARGIN_HEAT, 0);
+		m_heatMax = 0;
+	}
+
 	/// Focus the current running line.
 	int FocusCurrentLine(int line, bool isCurrentRunning=true) {
 		wxASSERT((line < 0) || (0 < line && line <= GetLineCount()));
@@ -483,7 +577,7 @@ public:
 			array.pop_back();
 		}
 
-		Mediator::Get()->GetEngine()->SendSaveSource(m_key, array);
+		Mediator::Get()->GetEngine()->SendSaveSource(m_sourceId, array);
 		ChangeModified(false);
 	}
 
@@ -492,11 +586,13 @@ private:
 	bool m_initialized;
 	bool m_isModified;
 
+	int m_sourceId;
 	std::string m_key;
 	wxString m_title;
 	bool m_hasPath;
 	int m_currentLine;
 	int m_markedLine;
+	int m_heatMax;
 
 	OneVariableWatchView *m_watch;
 
@@ -523,12 +619,15 @@ BEGIN_EVENT_TABLE(SourceView, wxAuiNotebook)
 	EVT_DEBUG_ADDED_SOURCE(wxID_ANY, SourceView::OnAddedSource)
 	EVT_DEBUG_FOCUS_ERRORLINE(wxID_ANY, SourceView::OnFocusErrorLine)
 	EVT_DEBUG_FOCUS_BACKTRACELINE(wxID_ANY, SourceView::OnFocusBacktraceLine)
+	EVT_TIMER(wxID_ANY, SourceView::OnHeatTimer)
 END_EVENT_TABLE()
 
 SourceView::SourceView(wxWindow *parent)
 	: wxAuiNotebook(parent, ID_SOURCEVIEW
 		, wxDefaultPosition, wxDefaultSize
-		, wxAUI_NB_TOP | wxAUI_NB_TAB_MOVE | wxAUI_NB_SCROLL_BUTTONS) {
+		, wxAUI_NB_TOP | wxAUI_NB_TAB_MOVE | wxAUI_NB_SCROLL_BUTTONS)
+	, m_heatTimer(this), m_isHeatShown(false), m_isHeatRequesting(false)
+	, m_heatGeneration(-1) {
 	CreateGUIControls();
 }
 
@@ -544,11 +643,11 @@ void SourceView::CreateGUIControls() {
 	}
 }
 
-size_t SourceView::FindPageFromKey(const std::string &key) {
+size_t SourceView::FindPageFromSourceId(int sourceId) {
 	for (size_t i = 0; i < GetPageCount(); ++i) {
 		SourceViewPage *page = GetPage(i);
 
-		if (page->GetKey() == key) {
+		if (page->GetSourceId() == sourceId) {
 			return i;
 		}
 	}
@@ -575,10 +674,104 @@ void SourceView::CreatePage(const Source &source) {
 	SourceViewPage *page = new SourceViewPage(this);
 	page->Initialize(source);
 	AddPage(page, page->GetTitle(), true);
+
+	if (m_isHeatShown) {
+		LuaLineHeatsMap::iterator it = m_heats.find(source.GetId());
+		if (it != m_heats.end()) {
+			page->SetHeats(it->second, NULL);
+		}
+	}
+}
+
+void SourceView::ShowHeatmap(bool show) {
+	if (show == m_isHeatShown) {
+		return;
+	}
+
+	// The heats are kept while hidden,
+	// because only the changed heats are sent.
+	m_isHeatShown = show;
+	for (size_t i = 0; i < GetPageCount(); ++i) {
+		SourceViewPage *page = GetPage(i);
+		LuaLineHeatsMap::iterator it = m_heats.find(page->GetSourceId());
+
+		if (show && it != m_heats.end()) {
+			page->SetHeats(it->second, NULL);
+		}
+		else {
+			page->ClearHeats();
+		}
+	}
+
+	if (show) {
+		m_heatTimer.Start(LLDEBUG_HEAT_INTERVAL);
+	}
+	else {
+		m_heatTimer.Stop();
+	}
+}
+
+struct RequestLineHeatsHandler {
+	SourceView *m_view;
+
+	explicit RequestLineHeatsHandler(SourceView *view)
+		: m_view(view) {
+	}
+
+	int operator()(const Command &/*command*/, int generation,
+				   const LuaLineHeatsMap &heats) {
+		m_view->UpdateHeats(generation, heats);
+		return 0;
+	}
+};
+
+/// Only the selected source is requested,
+/// and the next request waits for the response.
+void SourceView::OnHeatTimer(wxTimerEvent &/*event*/) {
+	SourceViewPage *page = GetSelected();
+	if (page == NULL || m_isHeatRequesting) {
+		return;
+	}
+
+	std::vector<int> sourceIds;
+	sourceIds.push_back(page->GetSourceId());
+	m_isHeatRequesting = true;
+	Mediator::Get()->GetEngine()->SendRequestLineHeats(
+		sourceIds, RequestLineHeatsHandler(this));
+}
+
+void SourceView::UpdateHeats(int generation, const LuaLineHeatsMap &heats) {
+	m_isHeatRequesting = false;
+
+	// The new generation means that the heats were cleared.
+	if (generation != m_heatGeneration) {
+		m_heatGeneration = generation;
+		m_heats.clear();
+		for (size_t i = 0; i < GetPageCount(); ++i) {
+			GetPage(i)->ClearHeats();
+		}
+	}
+
+	LuaLineHeatsMap::const_iterator it;
+	for (it = heats.begin(); it != heats.end(); ++it) {
+		LuaLineHeats &sourceHeats = m_heats[it->first];
+		LuaLineHeats::const_iterator lineIt;
+		for (lineIt = it->second.begin(); lineIt != it->second.end(); ++lineIt) {
+			sourceHeats[lineIt->first] = lineIt->second;
+		}
+
+		size_t i = FindPageFromSourceId(it->first);
+		if (m_isHeatShown && i != (size_t)wxNOT_FOUND) {
+			GetPage(i)->SetHeats(sourceHeats, &it->second);
+		}
+	}
 }
 
 void SourceView::OnEndDebug(wxDebugEvent &/*event*/) {
 	size_t count;
+	m_isHeatRequesting = false;
+	m_heatGeneration = -1;
+	m_heats.clear();
 	while ((count = GetPageCount()) > 0) {
 		DeletePage(count - 1);
 	}
@@ -608,7 +801,7 @@ struct RequestSourceHandler {
 	}
 
 	int operator()(const Command &/*command*/, const Source &source) {
-		if (source.GetKey().empty()) {
+		if (source.GetId() < 0) {
 			return -1;
 		}
 
@@ -628,7 +821,7 @@ void SourceView::OnUpdateSource(wxDebugEvent &event) {
 	for (size_t i = 0; i < GetPageCount(); ++i) {
 		SourceViewPage *page = GetPage(i);
 
-		if (page->GetKey() == event.GetKey()) {
+		if (page->GetSourceId() == event.GetSourceId()) {
 			page->FocusCurrentLine(event.GetLine());
 
 			// GetSelection is to avoid moving the focus carelessly.
@@ -646,7 +839,7 @@ void SourceView::OnUpdateSource(wxDebugEvent &event) {
 	// If there is no appropriate source, request it.
 	if (!found) {
 		Mediator::Get()->GetEngine()->SendRequestSource(
-			event.GetKey(),
+			event.GetSourceId(),
 			RequestSourceHandler(this, event));
 	}
 }
@@ -659,7 +852,7 @@ void SourceView::OnFocusErrorLine(wxDebugEvent &event) {
 	for (size_t i = 0; i < GetPageCount(); ++i) {
 		SourceViewPage *page = GetPage(i);
 
-		if (page->GetKey() == event.GetKey()) {
+		if (page->GetSourceId() == event.GetSourceId()) {
 			page->FocusErrorLine(event.GetLine());
 			SetSelection(i);
 			break;
@@ -671,7 +864,7 @@ void SourceView::OnFocusBacktraceLine(wxDebugEvent &event) {
 	for (size_t i = 0; i < GetPageCount(); ++i) {
 		SourceViewPage *page = GetPage(i);
 
-		if (page->GetKey() == event.GetBacktrace().GetKey()) {
+		if (page->GetSourceId() == event.GetSourceId()) {
 			page->FocusCurrentLine(event.GetLine(), false);
 			SetSelection(i);
 		}
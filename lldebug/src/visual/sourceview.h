@@ -46,9 +46,15 @@ public:
 	void ToggleBreakpoint();
 	void CreatePage(const Source &source);
 
+	/// Show or hide the heatmap of the lines.
+	void ShowHeatmap(bool show);
+
+	/// Apply the changed heats got from the debuggee.
+	void UpdateHeats(int generation, const LuaLineHeatsMap &heats);
+
 private:
 	void CreateGUIControls();
-	size_t FindPageFromKey(const std::string &key);
+	size_t FindPageFromSourceId(int sourceId);
 	SourceViewPage *GetPage(size_t i);
 	SourceViewPage *GetSelected();
 
@@ -59,8 +65,15 @@ private:
 	void OnAddedSource(wxDebugEvent &event);
 	void OnFocusErrorLine(wxDebugEvent &event);
 	void OnFocusBacktraceLine(wxDebugEvent &event);
+	void OnHeatTimer(wxTimerEvent &event);
 
 private:
+	wxTimer m_heatTimer;
+	bool m_isHeatShown;
+	bool m_isHeatRequesting; ///< waiting for the response
+	int m_heatGeneration;
+	LuaLineHeatsMap m_heats; ///< source id -> heats of the lines
+
 	DECLARE_EVENT_TABLE();
 };
 
@@ -31,6 +31,17 @@
 
 #include "wx/treelistctrl.h"
 
+/// The max bytes of the descendants' fields that are returned
+/// with the fields of a var. Zero disables the prefetch.
+#ifndef LLDEBUG_PREFETCH_BYTES
+#define LLDEBUG_PREFETCH_BYTES 0
+#endif
+
+/// The levels of the descendants whose fields are prefetched.
+#ifndef LLDEBUG_PREFETCH_DEPTH
+#define LLDEBUG_PREFETCH_DEPTH 1
+#endif
+
 namespace lldebug {
 namespace visual {
 
@@ -67,6 +78,11 @@ public:
 		}
 	}
 
+	/// Request this var again even if the update count isn't changed.
+	void Invalidate() {
+		m_requestCount = -1;
+	}
+
 	/// Get the update count.
 	int GetUpdateCount() const {
 		return m_updateCount;
@@ -95,6 +111,88 @@ typedef
 	boost::function1<void, const LuaVarListCallback &>
 	VarListRequester;
 
+/// Make the cache key of the var list request.
+static VarListCacheKey MakeCacheKey(const LuaHandle &lua, const char *kind,
+									int idx, const std::string &str) {
+	std::string key = kind;
+	key += boost::lexical_cast<std::string>(idx);
+	key += ":";
+	key += str;
+	return VarListCacheKey(lua, key);
+}
+
+/// Make the cache key of the fields of the var.
+static VarListCacheKey MakeFieldsCacheKey(const LuaVarRef &ref) {
+	return MakeCacheKey(
+		ref.GetLua(), "F", ref.GetTableIdx(),
+		boost::lexical_cast<std::string>(ref.GetGeneration()));
+}
+
+/// Make the string that identifies the filter.
+static std::string MakeFilterKey(const LuaVarFilter &filter) {
+	std::string key;
+	key += boost::lexical_cast<std::string>(filter.GetTypeMask()) + ":";
+	key += (filter.IsHideFunctions() ? "F" : "-");
+	key += (filter.IsHideCFunctions() ? "C" : "-");
+	key += boost::lexical_cast<std::string>((int)filter.GetSortOrder()) + ":";
+	key += boost::lexical_cast<std::string>(filter.GetMaxCount()) + ":";
+	key += filter.GetNamePattern();
+	return key;
+}
+
+/**
+ * @brief Request the var list through the cache of the mediator.
+ *
+ * The cached vars are used until the update count is changed,
+ * so reopening the view at the same stop doesn't send any requests.
+ */
+class CachedVarListRequester {
+public:
+	explicit CachedVarListRequester(const VarListCacheKey &key,
+									const VarListRequester &requester)
+		: m_key(key), m_requester(requester) {
+	}
+
+	void operator()(const LuaVarListCallback &callback) {
+		LuaVarList vars;
+
+		if (Mediator::Get()->FindVarListCache(m_key, vars) == 0) {
+			callback(lldebug::Command(), vars);
+			return;
+		}
+
+		m_requester(StoreCallback(m_key, callback));
+	}
+
+private:
+	/// Store the result to the cache and call the original callback.
+	struct StoreCallback {
+		explicit StoreCallback(const VarListCacheKey &key,
+							   const LuaVarListCallback &callback)
+			: m_key(key), m_callback(callback)
+			, m_updateCount(Mediator::Get()->GetUpdateCount()) {
+		}
+
+		int operator()(const lldebug::Command &command, const LuaVarList &vars) {
+			// The result of the old update mustn't be cached.
+			if (m_updateCount == Mediator::Get()->GetUpdateCount()) {
+				Mediator::Get()->SetVarListCache(m_key, vars);
+			}
+
+			return m_callback(command, vars);
+		}
+
+	private:
+		VarListCacheKey m_key;
+		LuaVarListCallback m_callback;
+		int m_updateCount;
+	};
+
+private:
+	VarListCacheKey m_key;
+	VarListRequester m_requester;
+};
+
 /**
  * @brief The common implementation of 'VariableWatch'.
  */
@@ -223,22 +321,68 @@ public:
 		}
 	}
 
+	/// Put the prefetched fields of the children into the cache,
+	/// so their expansions needn't wait for the context.
+	struct PrefetchCallback {
+		explicit PrefetchCallback(const LuaVarListCallback &callback)
+			: m_callback(callback)
+			, m_updateCount(Mediator::Get()->GetUpdateCount()) {
+		}
+		int operator()(const lldebug::Command &command, const LuaVarList &vars,
+					   const LuaVarListMap &prefetched) {
+			if (m_updateCount == Mediator::Get()->GetUpdateCount()) {
+				// The vars are numbered from 'vars' to the prefetched lists
+				// in the order of their keys, see Context::LuaPrefetchFields.
+				std::vector<const LuaVar *> numbered;
+				LuaVarList::const_iterator var;
+				for (var = vars.begin(); var != vars.end(); ++var) {
+					numbered.push_back(&*var);
+				}
+
+				LuaVarListMap::const_iterator it;
+				for (it = prefetched.begin(); it != prefetched.end(); ++it) {
+					if (it->first < 0 || it->first >= (int)numbered.size()) {
+						break;
+					}
+
+					Mediator::Get()->SetVarListCache(
+						MakeFieldsCacheKey(numbered[it->first]->GetRef()),
+						it->second);
+					for (var = it->second.begin(); var != it->second.end(); ++var) {
+						numbered.push_back(&*var);
+					}
+				}
+			}
+
+			return m_callback(command, vars);
+		}
+	private:
+		LuaVarListCallback m_callback;
+		int m_updateCount;
+	};
+
 	/// Request for the fields of the var.
+	/// Only the reference is sent, the value is never echoed back.
 	struct FieldsRequester {
 		explicit FieldsRequester(const LuaVar &var)
-			: m_var(var) {
+			: m_ref(var.GetRef()) {
 		}
 		void operator()(const LuaVarListCallback &callback) {
 			Mediator::Get()->GetEngine()->SendRequestFieldsVarList(
-				m_var, callback);
+				m_ref, Mediator::Get()->GetUpdateCount(),
+				LuaVarFilter(), LLDEBUG_PREFETCH_BYTES, LLDEBUG_PREFETCH_DEPTH,
+				PrefetchCallback(callback));
 		}
 	private:
-		LuaVar m_var;
+		LuaVarRef m_ref;
 		};
 
 	/// Begin the updating the fields of the var.
 	void BeginUpdating(wxTreeItemId item, bool isExpanded, const LuaVar &var) {
-		BeginUpdating(item, isExpanded, FieldsRequester(var));
+		BeginUpdating(item, isExpanded,
+			CachedVarListRequester(
+				MakeFieldsCacheKey(var.GetRef()),
+				FieldsRequester(var)));
 	}
 
 	/// Request for the results of the label evaluations.
@@ -266,9 +410,19 @@ public:
 				}
 			}
 
+			// The registered watches have been evaluated
+			// with the last update, so they needn't be requested.
+			LuaVarList vars;
+			Mediator::Get()->SetWatches(labels);
+			if (Mediator::Get()->GetWatchResults(labels, vars) == 0) {
+				callback(lldebug::Command(), vars);
+				return;
+			}
+
 			Mediator::Get()->GetEngine()->SendEvalsToVarList(
 				labels,
 				Mediator::Get()->GetStackFrame(),
+				LuaEvalBudget(),
 				callback);
 		}
 	private:
@@ -285,6 +439,16 @@ public:
 		}
 	}
 
+	/// Request the vars of this view again, e.g. when the filter is changed.
+	void RequestAgain() {
+		VariableWatchItemData *data = GetItemData(GetRootItem());
+		if (data != NULL) {
+			data->Invalidate();
+		}
+
+		BeginUpdating();
+	}
+
 	/// Clear this view.
 	void Clear() {
 		DeleteRoot();
@@ -365,6 +529,11 @@ private:
 
 			// To avoid the useless refresh, check change of the title.
 			wxString value = wxConvFromCtxEnc(var.GetValue());
+			if (var.IsTruncated()) {
+				value += wxString::Format(
+					_(" ... (truncated, full length %d)"),
+					var.GetValueLength());
+			}
 			if (GetItemText(item, 1) != value) {
 				SetItemText(item, 1, value);
 			}
@@ -427,6 +596,51 @@ private:
 		BeginUpdating(event.GetItem(), true, data->GetVar());
 	}
 
+	/// This object is called when the full value string is returned.
+	struct RequestVarValueCallback {
+		explicit RequestVarValueCallback(VariableWatch *watch, wxTreeItemId item)
+			: m_watch(watch), m_item(item)
+			, m_updateCount(Mediator::Get()->GetUpdateCount()) {
+		}
+
+		int operator()(const lldebug::Command &/*command*/, const std::string &str) {
+			if (m_updateCount != Mediator::Get()->GetUpdateCount()) {
+				return -1;
+			}
+
+			// Is m_watch still alive ?
+			if (ms_aliveInstanceSet.find(m_watch) == ms_aliveInstanceSet.end()) {
+				return -1;
+			}
+
+			if (!str.empty()) {
+				m_watch->SetItemText(m_item, 1, wxConvFromCtxEnc(str));
+			}
+			return 0;
+		}
+
+	private:
+		VariableWatch *m_watch;
+		wxTreeItemId m_item;
+		int m_updateCount;
+	};
+
+	friend struct RequestVarValueCallback;
+
+	/// Fetch the full value of the truncated var.
+	void OnActivated(wxTreeEvent &event) {
+		event.Skip();
+
+		VariableWatchItemData *data = GetItemData(event.GetItem());
+		if (data == NULL || !data->GetVar().IsTruncated()) {
+			return;
+		}
+
+		Mediator::Get()->GetEngine()->SendRequestVarValue(
+			data->GetVar().GetRef(), Mediator::Get()->GetUpdateCount(),
+			0, -1, RequestVarValueCallback(this, event.GetItem()));
+	}
+
 	void OnEndLabelEdit(wxTreeEvent &event) {
 		event.Skip();
 
@@ -544,6 +758,7 @@ VariableWatch::InstanceSet VariableWatch::ms_aliveInstanceSet;
 BEGIN_EVENT_TABLE(VariableWatch, wxTreeListCtrl)
 	EVT_SIZE(VariableWatch::OnSize)
 	EVT_TREE_ITEM_EXPANDED(wxID_ANY, VariableWatch::OnExpanded)
+	EVT_TREE_ITEM_ACTIVATED(wxID_ANY, VariableWatch::OnActivated)
 	EVT_TREE_END_LABEL_EDIT(wxID_ANY, VariableWatch::OnEndLabelEdit)
 	EVT_LIST_COL_END_DRAG(wxID_ANY, VariableWatch::OnColEndDrag)
 	EVT_DEBUG_END_DEBUG(wxID_ANY, VariableWatch::OnEndDebug)
@@ -587,11 +802,32 @@ struct OneVariableWatchView::VariableRequester {
 		m_valNameUTF8 = wxConvToCtxEnc(valName);
 	}
 	void operator()(const LuaVarListCallback &callback) {
-		Mediator::Get()->GetEngine()->SendEvalToMultiVar(
-			"return " + m_valNameUTF8,
-			Mediator::Get()->GetStackFrame(),
-			CallbackHandler(*m_watch, callback));
+		CachedVarListRequester requester(
+			MakeKey(m_valNameUTF8), EvalRequester(m_valNameUTF8));
+		requester(CallbackHandler(*m_watch, callback));
+	}
+
+	/// The value depends on the stack frame.
+	static VarListCacheKey MakeKey(const std::string &valName) {
+		const LuaStackFrame &stackFrame = Mediator::Get()->GetStackFrame();
+		return MakeCacheKey(
+			stackFrame.GetLua(), "M", stackFrame.GetLevel(), valName);
 	}
+private:
+	struct EvalRequester {
+		explicit EvalRequester(const std::string &valName)
+			: m_valName(valName) {
+		}
+		void operator()(const LuaVarListCallback &callback) {
+			Mediator::Get()->GetEngine()->SendEvalToMultiVar(
+				"return " + m_valName,
+				Mediator::Get()->GetStackFrame(),
+				LuaEvalBudget(),
+				callback);
+		}
+	private:
+		std::string m_valName;
+	};
 private:
 	VariableWatch **m_watch;
 	std::string m_valNameUTF8;
@@ -660,6 +896,7 @@ BEGIN_EVENT_TABLE(WatchView, wxPanel)
 	EVT_DEBUG_CHANGED_STATE(wxID_ANY, WatchView::OnChangedState)
 	EVT_DEBUG_UPDATE_SOURCE(wxID_ANY, WatchView::OnUpdateSource)
 	EVT_DEBUG_FOCUS_BACKTRACELINE(wxID_ANY, WatchView::OnFocusBacktraceLine)
+	EVT_TEXT_ENTER(wxID_ANY, WatchView::OnFilterEnter)
 END_EVENT_TABLE()
 
 static int GetWatchViewId(WatchView::Type type) {
@@ -681,27 +918,39 @@ static int GetWatchViewId(WatchView::Type type) {
 	return -1;
 }
 
+/// The filter is owned by the WatchView, which outlives its watch control.
 struct VarUpdateRequester {
-	explicit VarUpdateRequester(WatchView::Type type)
-		: m_type(type) {
+	explicit VarUpdateRequester(WatchView::Type type,
+								const LuaVarFilter &filter,
+								bool isCached = true)
+		: m_type(type), m_filter(&filter), m_isCached(isCached) {
 	}
 	void operator()(const LuaVarListCallback &callback) {
+		if (m_isCached) {
+			CachedVarListRequester requester(
+				MakeKey(), VarUpdateRequester(m_type, *m_filter, false));
+			requester(callback);
+			return;
+		}
+
 		switch (m_type) {
 		case WatchView::TYPE_LOCALWATCH:
 			Mediator::Get()->GetEngine()->SendRequestLocalVarList(
 				Mediator::Get()->GetStackFrame(),
-				true, true, false, callback);
+				true, true, false, *m_filter, callback);
 			break;
 		case WatchView::TYPE_ENVIRONWATCH:
 			Mediator::Get()->GetEngine()->SendRequestLocalVarList(
 				Mediator::Get()->GetStackFrame(),
-				false, false, true, callback);
+				false, false, true, *m_filter, callback);
 			break;
 		case WatchView::TYPE_GLOBALWATCH:
-			Mediator::Get()->GetEngine()->SendRequestGlobalVarList(callback);
+			Mediator::Get()->GetEngine()->SendRequestGlobalVarList(
+				*m_filter, callback);
 			break;
 		case WatchView::TYPE_REGISTRYWATCH:
-			Mediator::Get()->GetEngine()->SendRequestRegistryVarList(callback);
+			Mediator::Get()->GetEngine()->SendRequestRegistryVarList(
+				*m_filter, callback);
 			break;
 		case WatchView::TYPE_STACKWATCH:
 			Mediator::Get()->GetEngine()->SendRequestStackList(callback);
@@ -711,12 +960,40 @@ struct VarUpdateRequester {
 			break;
 		}
 	}
+private:
+	/// The local vars depend on the stack frame, the others don't.
+	VarListCacheKey MakeKey() const {
+		const LuaStackFrame &stackFrame = Mediator::Get()->GetStackFrame();
+		std::string filterKey = MakeFilterKey(*m_filter);
+
+		switch (m_type) {
+		case WatchView::TYPE_LOCALWATCH:
+			return MakeCacheKey(
+				stackFrame.GetLua(), "L", stackFrame.GetLevel(), filterKey);
+		case WatchView::TYPE_ENVIRONWATCH:
+			return MakeCacheKey(
+				stackFrame.GetLua(), "E", stackFrame.GetLevel(), filterKey);
+		case WatchView::TYPE_GLOBALWATCH:
+			return MakeCacheKey(LuaHandle(), "G", 0, filterKey);
+		case WatchView::TYPE_REGISTRYWATCH:
+			return MakeCacheKey(LuaHandle(), "R", 0, filterKey);
+		case WatchView::TYPE_STACKWATCH:
+		case WatchView::TYPE_WATCH:
+			break;
+		}
+
+		return MakeCacheKey(LuaHandle(), "S", 0, "");
+	}
+
 private:
 	WatchView::Type m_type;
+	const LuaVarFilter *m_filter;
+	bool m_isCached;
 };
 
 WatchView::WatchView(wxWindow *parent, Type type)
-	: wxPanel(parent, GetWatchViewId(type)), m_type(type) {
+	: wxPanel(parent, GetWatchViewId(type)), m_filterText(NULL)
+	, m_type(type) {
 
 	if (type == TYPE_WATCH) {
 		m_watch = new VariableWatch(
@@ -726,10 +1003,22 @@ WatchView::WatchView(wxWindow *parent, Type type)
 	else {
 		m_watch = new VariableWatch(
 			this, wxID_ANY, true, true,
-			false, false, VarUpdateRequester(type));
+			false, false, VarUpdateRequester(type, m_filter));
+	}
+
+	// The global and registry tables are often too large to list all,
+	// so they can be narrowed by the name pattern like 'str*'.
+	if (type == TYPE_GLOBALWATCH || type == TYPE_REGISTRYWATCH) {
+		m_filterText = new wxTextCtrl(
+			this, wxID_ANY, wxT(""),
+			wxDefaultPosition, wxDefaultSize,
+			wxTE_PROCESS_ENTER);
 	}
 
 	wxBoxSizer *sizer = new wxBoxSizer(wxVERTICAL);
+	if (m_filterText != NULL) {
+		sizer->Add(m_filterText, 0, wxEXPAND);
+	}
 	sizer->Add(m_watch, 1, wxEXPAND);
 	SetSizer(sizer);
 	sizer->SetSizeHints(this);
@@ -772,5 +1061,24 @@ void WatchView::OnShow(wxShowEvent &event) {
 	}
 }
 
+void WatchView::OnFilterEnter(wxCommandEvent &event) {
+	if (m_filterText == NULL || event.GetEventObject() != m_filterText) {
+		event.Skip();
+		return;
+	}
+
+	std::string pattern = wxConvToCtxEnc(m_filterText->GetValue());
+	m_filter.SetNamePattern(pattern);
+	m_filter.SetSortOrder(pattern.empty()
+		? LuaVarFilter::SORTORDER_NONE
+		: LuaVarFilter::SORTORDER_NAME);
+
+	// The vars must be requested again with the new filter
+	// even if the debuggee hasn't moved.
+	if (IsEnabled() && IsShown()) {
+		m_watch->RequestAgain();
+	}
+}
+
 } // end of namespace visual
 } // end of namespace lldebug
@@ -86,9 +86,12 @@ private:
 	void OnUpdateSource(wxDebugEvent &event);
 	void OnFocusBacktraceLine(wxDebugEvent &event);
 	void OnShow(wxShowEvent &event);
+	void OnFilterEnter(wxCommandEvent &event);
 
 private:
 	VariableWatch *m_watch;
+	wxTextCtrl *m_filterText;
+	LuaVarFilter m_filter;
 	Type m_type;
 
 	DECLARE_EVENT_TABLE();